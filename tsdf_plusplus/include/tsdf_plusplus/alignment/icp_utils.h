@@ -26,4 +26,25 @@ inline bool checkConvergenceState(ConvergenceState state)
   return success;
 }
 
+// Estimate the normals of a point cloud from its k nearest neighbors.
+template <typename PointT>
+inline void estimateNormals(const int k,
+                            typename pcl::PointCloud<PointT>::Ptr cloud)
+{
+  pcl::NormalEstimationOMP<PointT, pcl::Normal> normal_estimation;
+  normal_estimation.setInputCloud(cloud);
+  normal_estimation.setKSearch(k);
+
+  pcl::PointCloud<pcl::Normal> normals;
+  normal_estimation.compute(normals);
+
+  for (size_t i = 0u; i < cloud->points.size(); ++i)
+  {
+    cloud->points[i].normal_x = normals.points[i].normal_x;
+    cloud->points[i].normal_y = normals.points[i].normal_y;
+    cloud->points[i].normal_z = normals.points[i].normal_z;
+    cloud->points[i].curvature = normals.points[i].curvature;
+  }
+}
+
 #endif // TSDF_PLUSPLUS_ALIGNMENT_ICP_UTILS_H_
@@ -0,0 +1,184 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_CORE_BLOCK_HASH_TABLE_H_
+#define TSDF_PLUSPLUS_CORE_BLOCK_HASH_TABLE_H_
+
+#include <utility>
+#include <vector>
+
+#include <voxblox/core/block.h>
+#include <voxblox/core/common.h>
+
+using namespace voxblox;
+
+// Index from BlockIndex to the raw pointer of a block owned by a layer.
+// Lookups in the layer's BlockHashMap chase a pointer per bucket and copy a
+// shared_ptr, this table instead stores keys and pointers inline with open
+// addressing and Robin Hood probing, such that a lookup touches one or two
+// consecutive slots. The Morton code of a key is scrambled by Fibonacci
+// hashing, such that the dense clusters of blocks around the sensor are
+// spread evenly over the table rather than colliding.
+// The table does not own the blocks, its user must keep it in sync with the
+// layer. Lookups are thread safe as long as no insertion or removal happens
+// concurrently.
+template <typename VoxelType>
+class BlockHashTable {
+public:
+  typedef Block<VoxelType> BlockType;
+
+  BlockHashTable() { clear(); }
+
+  inline size_t size() const { return size_; }
+
+  inline bool empty() const { return size_ == 0u; }
+
+  // Returns nullptr if no block is stored at block_idx.
+  inline BlockType *find(const BlockIndex &block_idx) const {
+    size_t slot_idx = getHomeSlot(block_idx);
+    for (uint32_t distance = 1u;; ++distance) {
+      const Slot &slot = slots_[slot_idx];
+      // Empty slot or an entry closer to its home slot than the key would
+      // be, in both cases the key is not in the table.
+      if (slot.distance < distance) {
+        return nullptr;
+      }
+      if (slot.block_idx == block_idx) {
+        return slot.block;
+      }
+      slot_idx = (slot_idx + 1u) & mask_;
+    }
+  }
+
+  // Stores block at block_idx, replacing the block already stored there.
+  void insert(const BlockIndex &block_idx, BlockType *block) {
+    CHECK_NOTNULL(block);
+
+    if ((size_ + 1u) * kMaxLoadDenominator >
+        slots_.size() * kMaxLoadNumerator) {
+      rehash(2u * slots_.size());
+    }
+
+    if (insertWithoutRehash(block_idx, block)) {
+      ++size_;
+    }
+  }
+
+  // Returns false if no block is stored at block_idx.
+  bool erase(const BlockIndex &block_idx) {
+    size_t slot_idx = getHomeSlot(block_idx);
+    for (uint32_t distance = 1u;; ++distance) {
+      const Slot &slot = slots_[slot_idx];
+      if (slot.distance < distance) {
+        return false;
+      }
+      if (slot.block_idx == block_idx) {
+        break;
+      }
+      slot_idx = (slot_idx + 1u) & mask_;
+    }
+
+    // Backward shift deletion, the entries following the removed one move
+    // one slot closer to their home slot, no tombstones are needed.
+    size_t next_slot_idx = (slot_idx + 1u) & mask_;
+    while (slots_[next_slot_idx].distance > 1u) {
+      slots_[slot_idx] = slots_[next_slot_idx];
+      --slots_[slot_idx].distance;
+      slot_idx = next_slot_idx;
+      next_slot_idx = (next_slot_idx + 1u) & mask_;
+    }
+    slots_[slot_idx] = Slot();
+
+    --size_;
+    return true;
+  }
+
+  void clear() {
+    slots_.assign(kInitialCapacity, Slot());
+    mask_ = kInitialCapacity - 1u;
+    size_ = 0u;
+  }
+
+protected:
+  static constexpr size_t kInitialCapacity = 64u;
+
+  // Maximum fill ratio of the table before it grows.
+  static constexpr size_t kMaxLoadNumerator = 7u;
+  static constexpr size_t kMaxLoadDenominator = 8u;
+
+  struct Slot {
+    BlockIndex block_idx = BlockIndex::Zero();
+    BlockType *block = nullptr;
+    // One plus the distance of the entry from its home slot, 0 if empty.
+    uint32_t distance = 0u;
+  };
+
+  // Interleaves the lowest 21 bits of x with two zero bits each.
+  static inline uint64_t spreadBits(uint64_t x) {
+    x &= 0x1fffffu;
+    x = (x | x << 32u) & 0x1f00000000ffffu;
+    x = (x | x << 16u) & 0x1f0000ff0000ffu;
+    x = (x | x << 8u) & 0x100f00f00f00f00fu;
+    x = (x | x << 4u) & 0x10c30c30c30c30c3u;
+    x = (x | x << 2u) & 0x1249249249249249u;
+    return x;
+  }
+
+  inline size_t getHomeSlot(const BlockIndex &block_idx) const {
+    const uint64_t morton_code =
+        spreadBits(static_cast<uint64_t>(block_idx.x())) |
+        (spreadBits(static_cast<uint64_t>(block_idx.y())) << 1u) |
+        (spreadBits(static_cast<uint64_t>(block_idx.z())) << 2u);
+
+    // Fibonacci hashing, mixes the high bits of the code into the slot index.
+    return static_cast<size_t>((morton_code * 0x9e3779b97f4a7c15u) >> 32u) &
+           mask_;
+  }
+
+  // Returns false if an existing entry was replaced.
+  bool insertWithoutRehash(const BlockIndex &block_idx, BlockType *block) {
+    Slot entry;
+    entry.block_idx = block_idx;
+    entry.block = block;
+    entry.distance = 1u;
+
+    size_t slot_idx = getHomeSlot(block_idx);
+    while (true) {
+      Slot &slot = slots_[slot_idx];
+      if (slot.distance == 0u) {
+        slot = entry;
+        return true;
+      }
+      if (slot.distance == entry.distance &&
+          slot.block_idx == entry.block_idx) {
+        slot.block = entry.block;
+        return false;
+      }
+      // Take the slot of entries closer to their home slot, and carry on
+      // inserting the displaced entry instead.
+      if (slot.distance < entry.distance) {
+        std::swap(slot, entry);
+      }
+      ++entry.distance;
+      slot_idx = (slot_idx + 1u) & mask_;
+    }
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<Slot> old_slots(capacity, Slot());
+    old_slots.swap(slots_);
+    mask_ = capacity - 1u;
+
+    for (const Slot &slot : old_slots) {
+      if (slot.distance != 0u) {
+        insertWithoutRehash(slot.block_idx, slot.block);
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t mask_;
+  size_t size_;
+};
+
+#endif // TSDF_PLUSPLUS_CORE_BLOCK_HASH_TABLE_H_
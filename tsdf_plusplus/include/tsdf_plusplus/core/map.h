@@ -4,12 +4,16 @@
 #ifndef TSDF_PLUSPLUS_CORE_MAP_H_
 #define TSDF_PLUSPLUS_CORE_MAP_H_
 
+#include <algorithm>
+#include <deque>
 #include <shared_mutex>
 
 #include <voxblox/core/layer.h>
 
+#include "tsdf_plusplus/core/block_hash_table.h"
 #include "tsdf_plusplus/core/object_volume.h"
 #include "tsdf_plusplus/core/voxel.h"
+#include "tsdf_plusplus/core/voxel_indexer.h"
 
 using namespace voxblox;
 
@@ -19,6 +23,14 @@ public:
     float voxel_size = 0.2;
     size_t voxels_per_side = 16u;
 
+    // Object voxels are 2^shift times as large as the map voxels. Objects
+    // of the background class and objects whose first observed segment
+    // spans at least large_object_min_extent use a coarser resolution,
+    // all other objects use the map resolution.
+    unsigned int background_voxel_scale_shift = 0u;
+    unsigned int large_object_voxel_scale_shift = 0u;
+    float large_object_min_extent = 1.0f;
+
     std::string print() const;
   };
 
@@ -26,25 +38,60 @@ public:
 
   float block_size() const { return block_size_; }
 
+  inline const VoxelIndexer &getVoxelIndexer() const { return voxel_indexer_; }
+
+  // Largest voxel scale shift an object volume of the map can have.
+  inline unsigned int getMaxVoxelScaleShift() const {
+    return std::max(config_.background_voxel_scale_shift,
+                    config_.large_object_voxel_scale_shift);
+  }
+
+  // Voxel scale shift of a new object, given the extent of its first segment.
+  unsigned int selectVoxelScaleShift(const SemanticClass &semantic_class,
+                                     float extent) const;
+
   inline ObjectID *getHighestObjectIdPtr() { return highest_object_id_.get(); }
 
+  // Returns an object_id not used by any object in the map, to initialize new
+  // objects. The ids of removed objects are reused, oldest removal first.
+  // NOT thread safe.
+  ObjectID getFreshObjectId();
+
+  // The layer must not be modified directly, blocks are inserted
+  // through insertMapBlock() and allocateMapBlockPtrByIndex().
   inline Layer<MOVoxel> *getMapLayerPtr() { return map_layer_.get(); }
 
+  // Thread safe as long as no blocks are inserted concurrently.
+  // Returns nullptr if no block is allocated at block_idx.
+  inline Block<MOVoxel> *getMapBlockPtrByIndex(const BlockIndex &block_idx) {
+    return map_blocks_.find(block_idx);
+  }
+
+  // NOT thread safe.
+  void insertMapBlock(
+      const std::pair<const BlockIndex, Block<MOVoxel>::Ptr> &block_pair);
+
+  // NOT thread safe.
+  Block<MOVoxel> *allocateMapBlockPtrByIndex(const BlockIndex &block_idx);
+
   inline std::map<ObjectID, ObjectVolume *> *getObjectVolumesPtr() {
     return object_volumes_.get();
   }
 
   ObjectVolume *getObjectVolumePtrById(const ObjectID &object_id);
 
-  // Get the object volume by its object_id if
-  // it already exists, else allocate a new one.
+  // Get the object volume by its object_id if it already exists, else
+  // allocate a new one whose resolution is chosen from its semantic_class and
+  // extent.
   ObjectVolume *allocateObjectVolumePtrById(const Point centroid,
                                             const SemanticClass &semantic_class,
-                                            const ObjectID &object_id);
+                                            const ObjectID &object_id,
+                                            float extent = 0.0f);
 
   // Thread safe.
   // Returns a pointer to the TSDF voxels located at global_voxel_idx in the
-  // specified object_id volume.
+  // specified object_id volume. Indices passed to the TSDF voxel getters are
+  // those of map voxels, the object voxel covering the map voxel is returned.
   // Takes in the last_object_id, last_tsdf_block and last_tsdf_block_idx to
   // prevent unneeded lookups. If the voxel belongs to a block that has not been
   // allocated, a block in the corresponding object's temp_block_map_ is
@@ -55,7 +102,19 @@ public:
       const Point centroid, const SemanticClass &semantic_class,
       const ObjectID &object_id, const GlobalIndex &global_voxel_idx,
       ObjectVolume **last_object_volume, ObjectID *last_object_id,
-      Block<TsdfVoxel>::Ptr *last_tsdf_block, BlockIndex *last_tsdf_block_idx);
+      Block<TsdfVoxel> **last_tsdf_block, BlockIndex *last_tsdf_block_idx);
+
+  // Thread safe.
+  // Returns a pointer to the TSDF voxel located at global_voxel_idx in the
+  // specified object_id volume, or nullptr if the object has no block
+  // allocated there. Unlike allocateStorageAndGetVoxelPtr nothing is
+  // allocated, blocks created in the current integration are not visible.
+  TsdfVoxel *getAllocatedTsdfVoxelPtr(const ObjectID &object_id,
+                                      const GlobalIndex &global_voxel_idx,
+                                      ObjectVolume **last_object_volume,
+                                      ObjectID *last_object_id,
+                                      Block<TsdfVoxel> **last_tsdf_block,
+                                      BlockIndex *last_tsdf_block_idx);
 
   // Gets the TSDF voxel of an object volume at the specified voxel_index.
   TsdfVoxel *getTsdfVoxelPtrByVoxelIndex(const ObjectID &object_id,
@@ -63,32 +122,45 @@ public:
                                          const VoxelIndex &voxel_index,
                                          ObjectVolume **last_object_volume,
                                          ObjectID *last_object_id,
-                                         Block<TsdfVoxel>::Ptr *last_tsdf_block,
+                                         Block<TsdfVoxel> **last_tsdf_block,
                                          BlockIndex *last_tsdf_block_idx);
 
   // Gets the TSDF voxel of an object volume at the specified voxel_index.
   TsdfVoxel *getTsdfVoxelPtrByLinearIndex(
       const ObjectID &object_id, const BlockIndex &block_index,
       const IndexElement &voxel_index, ObjectVolume **last_object_volume,
-      ObjectID *last_object_id, Block<TsdfVoxel>::Ptr *last_tsdf_block,
+      ObjectID *last_object_id, Block<TsdfVoxel> **last_tsdf_block,
       BlockIndex *last_tsdf_block_idx);
 
   void transformLayer(const ObjectID &object_id,
                       const Transformation &T_out_in);
 
-  void removeObject(const ObjectID &object_id);
+  // Removes the object from the map layer and deletes its object volume, its
+  // object_id is then reused for new objects. Map blocks left empty by the
+  // removal are deallocated and their indices appended to
+  // pruned_block_indices, if not null. Returns the number of bytes freed.
+  // NOT thread safe.
+  size_t removeObject(const ObjectID &object_id,
+                      BlockIndexList *pruned_block_indices = nullptr);
 
   void clear();
 
 protected:
+  // Indices of all the map blocks overlapped by the blocks of object_volume.
+  void getCoveredMapBlocks(ObjectVolume *object_volume,
+                           BlockIndexList *map_block_indices) const;
+
   Config config_;
 
-  float voxels_per_side_inv_;
+  VoxelIndexer voxel_indexer_;
   float block_size_;
 
   // Global map volume.
   std::unique_ptr<Layer<MOVoxel>> map_layer_;
 
+  // Raw pointer index of the blocks in map_layer_.
+  BlockHashTable<MOVoxel> map_blocks_;
+
   // List of the TSDF object volumes in the map.
   std::unique_ptr<std::map<ObjectID, ObjectVolume *>> object_volumes_;
 
@@ -97,6 +169,9 @@ protected:
 
   // Field to keep track of the highest object_id generated in the map.
   std::unique_ptr<ObjectID> highest_object_id_;
+
+  // Ids of removed objects, available for reuse.
+  std::deque<ObjectID> free_object_ids_;
 };
 
 #endif // TSDF_PLUSPLUS_CORE_MAP_H_
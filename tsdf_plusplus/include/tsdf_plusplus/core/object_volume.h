@@ -4,18 +4,25 @@
 #ifndef TSDF_PLUSPLUS_CORE_OBJECT_VOLUME_H_
 #define TSDF_PLUSPLUS_CORE_OBJECT_VOLUME_H_
 
+#include <chrono>
 #include <mutex>
 
 #include <voxblox/core/layer.h>
 #include <voxblox/core/voxel.h>
 
+#include "tsdf_plusplus/core/block_hash_table.h"
 #include "tsdf_plusplus/core/voxel.h"
+#include "tsdf_plusplus/core/voxel_indexer.h"
 
 using namespace voxblox;
 
+// TSDF volume of a single object. Its voxels are 2^voxel_scale_shift times as
+// large as the voxels of the map layer, such that each object voxel covers a
+// cube of map voxels.
 class ObjectVolume {
 public:
-  ObjectVolume(float voxel_size, size_t voxels_per_side, const Point centroid,
+  ObjectVolume(float map_voxel_size, size_t voxels_per_side,
+               unsigned int voxel_scale_shift, const Point centroid,
                const SemanticClass &semantic_class);
 
   inline SemanticClass getSemanticClass() { return semantic_class_; }
@@ -24,20 +31,75 @@ public:
     semantic_class_ = semantic_class;
   }
 
+  // The layer must not be modified directly, blocks are
+  // inserted through updateLayerWithStoredBlocks().
   inline Layer<TsdfVoxel> *getTsdfLayerPtr() { return tsdf_layer_.get(); }
 
+  // Replaces the TSDF layer, taking ownership of tsdf_layer.
+  void resetTsdfLayer(Layer<TsdfVoxel> *tsdf_layer);
+
+  // Thread safe as long as no blocks are merged concurrently.
+  // Returns nullptr if no block is allocated at block_idx, blocks that are
+  // still in temp_block_map_ are not visible.
+  inline Block<TsdfVoxel> *getTsdfBlockPtrByIndex(const BlockIndex &block_idx) {
+    return tsdf_blocks_.find(block_idx);
+  }
+
+  // Thread safe as long as no blocks are merged concurrently.
+  // Returns nullptr if no block is allocated at the object voxel.
+  inline TsdfVoxel *
+  getTsdfVoxelPtrByGlobalIndex(const GlobalIndex &object_voxel_idx) const {
+    Block<TsdfVoxel> *block =
+        tsdf_blocks_.find(voxel_indexer_.getBlockIndex(object_voxel_idx));
+    if (block == nullptr) {
+      return nullptr;
+    }
+    return &block->getVoxelByLinearIndex(
+        voxel_indexer_.getLinearIndex(object_voxel_idx));
+  }
+
+  inline unsigned int getVoxelScaleShift() const { return voxel_scale_shift_; }
+
+  // Index of the object voxel covering the map voxel global_voxel_idx.
+  inline GlobalIndex
+  getObjectVoxelIndex(const GlobalIndex &global_voxel_idx) const {
+    if (voxel_scale_shift_ == 0u) {
+      return global_voxel_idx;
+    }
+    return GlobalIndex(global_voxel_idx.x() >> voxel_scale_shift_,
+                       global_voxel_idx.y() >> voxel_scale_shift_,
+                       global_voxel_idx.z() >> voxel_scale_shift_);
+  }
+
+  // Trilinearly interpolates the SDF at point from the eight surrounding
+  // voxel centers. Returns false if any of them is unallocated or has less
+  // than min_weight.
+  bool getInterpolatedDistance(const Point &point, float min_weight,
+                               FloatingPoint *distance) const;
+
   inline Transformation getPose() { return pose_; }
 
   void accumulateTransform(Transformation transform);
 
+  // Observation statistics, used to detect spurious objects.
+  void recordObservation();
+
+  inline size_t getNumObservations() const { return num_observations_; }
+
+  inline std::chrono::steady_clock::time_point getLastObservationTime() const {
+    return last_observation_time_;
+  }
+
+  // Number of voxels of the TSDF layer with at least min_weight.
+  size_t countObservedVoxels(float min_weight) const;
+
   // Thread safe.
   // Returns a pointer to a TSDF block located at block_idx in the TSDF layer.
   // A block in temp_block_map_ is created/accessed and returned. Accessing
   // temp_block_map_ is controlled via a mutex allowing it to grow in a thread
   // safe manner during integration. These temporary blocks can be merged into
   // the TSDF layer by calling updateLayerWithStoredBlocks().
-  Block<TsdfVoxel>::Ptr
-  allocateStorageAndGetBlockPtr(const BlockIndex &block_idx);
+  Block<TsdfVoxel> *allocateStorageAndGetBlockPtr(const BlockIndex &block_idx);
 
   // Merges temporarily stored blocks into the TSDF layer.
   // NOT thread safe, see allocateStorageAndGetBlockPtr() for more details.
@@ -47,6 +109,12 @@ protected:
   // TSDF layer of the object.
   std::unique_ptr<Layer<TsdfVoxel>> tsdf_layer_;
 
+  // Raw pointer index of the blocks in tsdf_layer_.
+  BlockHashTable<TsdfVoxel> tsdf_blocks_;
+
+  const unsigned int voxel_scale_shift_;
+  const VoxelIndexer voxel_indexer_;
+
   SemanticClass semantic_class_;
 
   // Temporary storage and mutex for blocks that need
@@ -57,6 +125,10 @@ protected:
   // G_T_G_O i.e. transformation from object to global frame
   // expressed in global frame.
   Transformation pose_;
+
+  // Number of segments integrated into the object.
+  size_t num_observations_;
+  std::chrono::steady_clock::time_point last_observation_time_;
 };
 
 #endif // TSDF_PLUSPLUS_CORE_OBJECT_VOLUME_H_
@@ -4,6 +4,11 @@
 #ifndef TSDF_PLUSPLUS_CORE_SEGMENT_H_
 #define TSDF_PLUSPLUS_CORE_SEGMENT_H_
 
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include <voxblox/core/common.h>
 
 #include "tsdf_plusplus/core/common.h"
@@ -13,14 +18,44 @@ class Segment
 public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
+        // If with_colors is false, colors_ is left empty.
         Segment(const pcl::PointCloud<InputPointType> &pointcloud_pcl,
-                const voxblox::Transformation &T_G_C);
+                const voxblox::Transformation &T_G_C,
+                bool with_colors = true);
 
         Segment(const pcl::PointCloud<GTInputPointType> &pointcloud_pcl,
-                const voxblox::Transformation &T_G_C, const ObjectID object_id);
+                const voxblox::Transformation &T_G_C, const ObjectID object_id,
+                bool with_colors = true);
+
+        // Empty segment whose points and colors are filled in directly, e.g.
+        // when unprojecting a label image. No pcl::PointCloud is kept, call
+        // computeCentroid() once all points have been added.
+        Segment(const voxblox::Transformation &T_G_C, const ObjectID object_id,
+                const SemanticClass semantic_class);
+
+        // Same as the constructors, for segments that are reused. The buffers
+        // of the segment are overwritten in place, keeping their capacity.
+        void assign(const pcl::PointCloud<InputPointType> &pointcloud_pcl,
+                    const voxblox::Transformation &T_G_C,
+                    bool with_colors = true);
+
+        void assign(const pcl::PointCloud<GTInputPointType> &pointcloud_pcl,
+                    const voxblox::Transformation &T_G_C,
+                    const ObjectID object_id, bool with_colors = true);
+
+        void assign(const voxblox::Transformation &T_G_C,
+                    const ObjectID object_id,
+                    const SemanticClass semantic_class);
+
+        // Populate a voxblox::Pointcloud, and optionally
+        // voxblox::Colors, from the pcl::PointCloud data.
+        void convertPointcloud(bool with_colors = true);
 
-        // Populate a voxblox::Pointcloud from the pcl::PointCloud data.
-        void convertPointcloud();
+        // Compute the centroid in global frame from points_C_.
+        void computeCentroid();
+
+        // Append the points of another segment of the same frame.
+        void merge(const Segment &segment);
 
         voxblox::Transformation T_G_C_;
         voxblox::Pointcloud points_C_;
@@ -32,4 +67,79 @@ public:
         pcl::PointCloud<InputPointType> pointcloud_;
 };
 
+// Segments of the current frame, recycled from frame to frame. Once the
+// buffers of the segments have grown to the size of a typical frame, a new
+// frame does not allocate any segment or point memory.
+// NOT thread safe.
+class SegmentPool
+{
+public:
+        // Returns a segment assigned from args, see Segment::assign. It stays
+        // valid until the next call to releaseAll().
+        template <typename... Args>
+        Segment *acquire(Args &&... args)
+        {
+                if (num_acquired_ == segments_.size())
+                {
+                        segments_.emplace_back(
+                            new Segment(std::forward<Args>(args)...));
+                }
+                else
+                {
+                        segments_[num_acquired_]->assign(
+                            std::forward<Args>(args)...);
+                }
+                return segments_[num_acquired_++].get();
+        }
+
+        // Returns all acquired segments to the pool.
+        inline void releaseAll() { num_acquired_ = 0u; }
+
+        // Frees the segments, e.g. after a frame much larger than usual.
+        void clear();
+
+protected:
+        std::vector<std::unique_ptr<Segment>> segments_;
+        size_t num_acquired_ = 0u;
+};
+
+// Raw, row-major images of a segmented frame, all of the same size. Each
+// buffer must hold height rows of step bytes, with step at least width times
+// the size of a pixel.
+struct SegmentImages
+{
+        size_t width = 0u;
+        size_t height = 0u;
+
+        // Depth in meters as float, or in millimeters as uint16_t.
+        const uint8_t *depth = nullptr;
+        size_t depth_step = 0u;
+        bool depth_in_mm = false;
+
+        // 8-bit color with color_channels channels, in RGB(A) or BGR(A) order.
+        // Left null to unproject the points without colors.
+        const uint8_t *color = nullptr;
+        size_t color_step = 0u;
+        size_t color_channels = 3u;
+        bool bgr_order = false;
+
+        // uint16_t instance labels, 0 marks pixels of no instance.
+        const uint8_t *labels = nullptr;
+        size_t labels_step = 0u;
+
+        // Pinhole intrinsics.
+        float fx = 0.0f;
+        float fy = 0.0f;
+        float cx = 0.0f;
+        float cy = 0.0f;
+};
+
+// Unproject the labeled pixels of the images into the points and colors of
+// the segment of their label, in a single pass over the images. Pixels whose
+// label has no segment or without valid depth are dropped. The centroids of
+// the segments are computed at the end.
+void unprojectSegments(
+    const SegmentImages &images,
+    const std::unordered_map<uint16_t, Segment *> &label_segments);
+
 #endif // TSDF_PLUSPLUS_CORE_SEGMENT_H_
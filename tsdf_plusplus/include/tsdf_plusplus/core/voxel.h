@@ -4,12 +4,147 @@
 #ifndef TSDF_PLUSPLUS_CORE_VOXEL_H_
 #define TSDF_PLUSPLUS_CORE_VOXEL_H_
 
+#include <algorithm>
+#include <limits>
+
 #include "tsdf_plusplus/core/common.h"
 
+// Number of objects a voxel keeps track of, each slot costs sizeof(Object),
+// i.e. 4 bytes. Must be defined consistently for all the packages including
+// this header, e.g. through CMAKE_CXX_FLAGS.
+#ifndef TSDF_PLUSPLUS_MOVOXEL_SLOTS
+#define TSDF_PLUSPLUS_MOVOXEL_SLOTS 2
+#endif
+
 // Multi-object TSDF++ voxel.
-struct MOVoxel {
-  Object active_object;
-  Object inactive_object;
+template <size_t kNumSlots>
+struct MultiObjectVoxel {
+  static_assert(kNumSlots >= 2u, "A voxel needs at least two object slots.");
+
+  // Objects ranked by decreasing confidence, empty slots are at the end.
+  // The first slot holds the active object. If it is empty, i.e. the voxel
+  // holds no objects, its confidence is the free confidence of the voxel
+  // instead, so that the voxel stays kNumSlots * sizeof(Object) bytes.
+  Object objects[kNumSlots];
+
+  inline const Object &active_object() const { return objects[0]; }
+
+  // Number of consecutive free space observations of the voxel since it was
+  // last observed close to a surface.
+  inline Confidence free_confidence() const {
+    return (objects[0].object_id == EmptyID) ? objects[0].confidence : 0u;
+  }
+
+  // Whether the voxel holds neither objects nor free space observations.
+  inline bool isEmpty() const {
+    return objects[0].object_id == EmptyID && objects[0].confidence == 0u;
+  }
+
+  // Accumulates an observation of object_id. The object gains confidence and
+  // moves up in the ranking, only overtaking objects of strictly lower
+  // confidence. A previously unseen object takes the first empty slot, or, if
+  // all slots are in use, wears down the least confident object and replaces
+  // it once its confidence reaches zero.
+  inline void observeObject(const ObjectID &object_id) {
+    resetFreeConfidence();
+
+    size_t slot_idx = 0u;
+    while (slot_idx < kNumSlots &&
+           objects[slot_idx].object_id != object_id &&
+           objects[slot_idx].object_id != EmptyID) {
+      ++slot_idx;
+    }
+
+    if (slot_idx == kNumSlots) {
+      slot_idx = kNumSlots - 1u;
+      if (--objects[slot_idx].confidence > 0u) {
+        return;
+      }
+    }
+
+    Object &object = objects[slot_idx];
+    object.object_id = object_id;
+    if (object.confidence < std::numeric_limits<Confidence>::max()) {
+      ++object.confidence;
+    }
+
+    for (; slot_idx > 0u && objects[slot_idx].confidence >
+                                objects[slot_idx - 1u].confidence;
+         --slot_idx) {
+      std::swap(objects[slot_idx], objects[slot_idx - 1u]);
+    }
+  }
+
+  // Accumulates an observation of free space. The active object loses
+  // confidence and moves down in the ranking, it is dropped once its
+  // confidence reaches zero. A voxel without objects gains free confidence.
+  inline void observeFreeSpace() {
+    if (objects[0].object_id == EmptyID) {
+      if (objects[0].confidence < std::numeric_limits<Confidence>::max()) {
+        ++objects[0].confidence;
+      }
+      return;
+    }
+
+    if (--objects[0].confidence == 0u) {
+      const ObjectID object_id = objects[0].object_id;
+      removeObject(object_id);
+      return;
+    }
+
+    for (size_t slot_idx = 0u;
+         slot_idx < kNumSlots - 1u &&
+         objects[slot_idx].confidence < objects[slot_idx + 1u].confidence;
+         ++slot_idx) {
+      std::swap(objects[slot_idx], objects[slot_idx + 1u]);
+    }
+  }
+
+  // Makes object_id the active object with the given confidence regardless of
+  // the ranking, the other objects are moved one slot down.
+  inline void activateObject(const ObjectID &object_id,
+                             const Confidence &confidence) {
+    resetFreeConfidence();
+    removeObject(object_id);
+
+    for (size_t slot_idx = kNumSlots - 1u; slot_idx > 0u; --slot_idx) {
+      objects[slot_idx] = objects[slot_idx - 1u];
+    }
+
+    objects[0].object_id = object_id;
+    objects[0].confidence = confidence;
+  }
+
+  // Removes object_id from the voxel, the objects ranked
+  // after it are moved one slot up.
+  inline void removeObject(const ObjectID &object_id) {
+    size_t slot_idx = 0u;
+    while (slot_idx < kNumSlots && objects[slot_idx].object_id != object_id) {
+      ++slot_idx;
+    }
+
+    if (slot_idx == kNumSlots) {
+      return;
+    }
+
+    for (; slot_idx < kNumSlots - 1u; ++slot_idx) {
+      objects[slot_idx] = objects[slot_idx + 1u];
+    }
+    objects[kNumSlots - 1u] = Object();
+  }
+
+protected:
+  inline void resetFreeConfidence() {
+    if (objects[0].object_id == EmptyID) {
+      objects[0].confidence = 0u;
+    }
+  }
 };
 
+typedef MultiObjectVoxel<TSDF_PLUSPLUS_MOVOXEL_SLOTS> MOVoxel;
+
+static_assert(sizeof(MOVoxel) ==
+                  TSDF_PLUSPLUS_MOVOXEL_SLOTS * sizeof(Object),
+              "MOVoxel must not grow beyond its object slots.");
+
 #endif  // TSDF_PLUSPLUS_CORE_VOXEL_H_
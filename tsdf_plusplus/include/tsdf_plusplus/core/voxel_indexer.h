@@ -0,0 +1,69 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_CORE_VOXEL_INDEXER_H_
+#define TSDF_PLUSPLUS_CORE_VOXEL_INDEXER_H_
+
+#include <voxblox/core/common.h>
+
+using namespace voxblox;
+
+// Conversions between global voxel indices and block, local and linear voxel
+// indices. voxels_per_side is a power of two, so instead of the floating
+// point divisions of voxblox the conversions reduce to shifts and masks.
+// Right shifts of negative indices are arithmetic, i.e. they round towards
+// negative infinity as the block index requires.
+class VoxelIndexer {
+public:
+  explicit VoxelIndexer(size_t voxels_per_side)
+      : shift_(0u), mask_(static_cast<LongIndexElement>(voxels_per_side) - 1) {
+    CHECK(isPowerOfTwo(static_cast<int>(voxels_per_side)))
+        << "voxels_per_side must be a power of 2.";
+    while ((size_t(1u) << shift_) < voxels_per_side) {
+      ++shift_;
+    }
+  }
+
+  inline size_t voxels_per_side() const {
+    return static_cast<size_t>(mask_ + 1);
+  }
+
+  inline BlockIndex getBlockIndex(const GlobalIndex &global_voxel_idx) const {
+    return BlockIndex(static_cast<IndexElement>(global_voxel_idx.x() >> shift_),
+                      static_cast<IndexElement>(global_voxel_idx.y() >> shift_),
+                      static_cast<IndexElement>(global_voxel_idx.z() >> shift_));
+  }
+
+  inline VoxelIndex
+  getLocalVoxelIndex(const GlobalIndex &global_voxel_idx) const {
+    return VoxelIndex(static_cast<IndexElement>(global_voxel_idx.x() & mask_),
+                      static_cast<IndexElement>(global_voxel_idx.y() & mask_),
+                      static_cast<IndexElement>(global_voxel_idx.z() & mask_));
+  }
+
+  // Same ordering as Block::computeLinearIndexFromVoxelIndex.
+  inline size_t getLinearIndex(const GlobalIndex &global_voxel_idx) const {
+    return static_cast<size_t>((global_voxel_idx.x() & mask_) |
+                               ((global_voxel_idx.y() & mask_) << shift_) |
+                               ((global_voxel_idx.z() & mask_) << (2u * shift_)));
+  }
+
+  inline VoxelIndex getVoxelIndexFromLinearIndex(size_t linear_idx) const {
+    const LongIndexElement idx = static_cast<LongIndexElement>(linear_idx);
+    return VoxelIndex(static_cast<IndexElement>(idx & mask_),
+                      static_cast<IndexElement>((idx >> shift_) & mask_),
+                      static_cast<IndexElement>(idx >> (2u * shift_)));
+  }
+
+  inline GlobalIndex getGlobalVoxelIndex(const BlockIndex &block_idx,
+                                         const VoxelIndex &voxel_idx) const {
+    return (block_idx.cast<LongIndexElement>() * (mask_ + 1)) +
+           voxel_idx.cast<LongIndexElement>();
+  }
+
+protected:
+  unsigned int shift_;
+  LongIndexElement mask_;
+};
+
+#endif // TSDF_PLUSPLUS_CORE_VOXEL_INDEXER_H_
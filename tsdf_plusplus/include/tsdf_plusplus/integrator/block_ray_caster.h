@@ -0,0 +1,183 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_INTEGRATOR_BLOCK_RAY_CASTER_H_
+#define TSDF_PLUSPLUS_INTEGRATOR_BLOCK_RAY_CASTER_H_
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <voxblox/core/common.h>
+
+#include "tsdf_plusplus/core/voxel_indexer.h"
+
+using namespace voxblox;
+
+// Voxel traversal of a ray, same as voxblox's RayCaster, which instead of one
+// voxel at a time yields runs of consecutive voxels lying in the same block.
+// The caller looks up the block once per run and then updates its voxels by
+// linear index. Block changes are detected by the local voxel index leaving
+// the block, the linear index is updated incrementally at each step.
+class BlockRayCaster {
+public:
+  // Voxels of a ray within one block, in traversal order.
+  struct VoxelRun {
+    BlockIndex block_idx;
+    AlignedVector<GlobalIndex> global_voxel_indices;
+    std::vector<size_t> linear_indices;
+
+    inline size_t size() const { return linear_indices.size(); }
+
+    inline void clear() {
+      global_voxel_indices.clear();
+      linear_indices.clear();
+    }
+  };
+
+  // Casts the ray the same way as the corresponding voxblox RayCaster
+  // constructor does.
+  BlockRayCaster(const Point &origin, const Point &point_G,
+                 const bool is_clearing_ray, const bool voxel_carving_enabled,
+                 const FloatingPoint max_ray_length_m,
+                 const FloatingPoint voxel_size_inv,
+                 const FloatingPoint truncation_distance,
+                 const VoxelIndexer &voxel_indexer)
+      : voxel_indexer_(voxel_indexer),
+        voxels_per_side_(
+            static_cast<IndexElement>(voxel_indexer.voxels_per_side())) {
+    const Ray unit_ray = (point_G - origin).normalized();
+
+    Point ray_start, ray_end;
+    if (is_clearing_ray) {
+      FloatingPoint ray_length = (point_G - origin).norm();
+      ray_length = std::min(
+          std::max(ray_length - truncation_distance, FloatingPoint(0.0)),
+          max_ray_length_m);
+      ray_end = origin + unit_ray * ray_length;
+      ray_start = voxel_carving_enabled ? origin : ray_end;
+    } else {
+      ray_end = point_G + unit_ray * truncation_distance;
+      ray_start = voxel_carving_enabled
+                      ? origin
+                      : (point_G - unit_ray * truncation_distance);
+    }
+
+    setup(ray_start * voxel_size_inv, ray_end * voxel_size_inv);
+  }
+
+  // Fills run with the voxels of the next block along the ray. Returns false
+  // once the whole ray has been traversed.
+  inline bool nextRun(VoxelRun *run) {
+    run->clear();
+
+    if (current_step_ > ray_length_in_steps_) {
+      return false;
+    }
+
+    run->block_idx = voxel_indexer_.getBlockIndex(curr_index_);
+
+    while (current_step_ <= ray_length_in_steps_) {
+      run->global_voxel_indices.push_back(curr_index_);
+      run->linear_indices.push_back(curr_linear_idx_);
+      ++current_step_;
+
+      int axis;
+      t_to_next_boundary_.minCoeff(&axis);
+      curr_index_[axis] += ray_step_signs_[axis];
+      curr_local_idx_[axis] += ray_step_signs_[axis];
+      curr_linear_idx_ += ray_step_signs_[axis] * linear_strides_[axis];
+      t_to_next_boundary_[axis] += t_step_size_[axis];
+
+      if (curr_local_idx_[axis] < 0 ||
+          curr_local_idx_[axis] >= voxels_per_side_) {
+        // The ray entered a new block.
+        curr_local_idx_[axis] -= ray_step_signs_[axis] * voxels_per_side_;
+        curr_linear_idx_ -=
+            ray_step_signs_[axis] * voxels_per_side_ * linear_strides_[axis];
+        break;
+      }
+    }
+
+    return true;
+  }
+
+  // Whether another run follows the one returned last.
+  inline bool hasNextRun() const {
+    return current_step_ <= ray_length_in_steps_;
+  }
+
+  // Block and linear index of the first voxel of the next run,
+  // only valid if hasNextRun().
+  inline BlockIndex getNextBlockIndex() const {
+    return voxel_indexer_.getBlockIndex(curr_index_);
+  }
+  inline size_t getNextLinearIndex() const {
+    return static_cast<size_t>(curr_linear_idx_);
+  }
+
+protected:
+  void setup(const Point &start_scaled, const Point &end_scaled) {
+    current_step_ = 0;
+    ray_length_in_steps_ = -1;
+
+    if (!start_scaled.allFinite() || !end_scaled.allFinite()) {
+      return;
+    }
+
+    curr_index_ = getGridIndexFromPoint<GlobalIndex>(start_scaled);
+    const GlobalIndex end_index = getGridIndexFromPoint<GlobalIndex>(end_scaled);
+    const GlobalIndex diff_index = end_index - curr_index_;
+
+    ray_length_in_steps_ = std::abs(diff_index.x()) +
+                           std::abs(diff_index.y()) + std::abs(diff_index.z());
+
+    const Ray ray_scaled = end_scaled - start_scaled;
+    const Point start_scaled_shifted =
+        start_scaled - curr_index_.cast<FloatingPoint>();
+
+    for (unsigned int i = 0u; i < 3u; ++i) {
+      ray_step_signs_[i] = signum(ray_scaled[i]);
+
+      // Axes the ray is parallel to are never stepped along.
+      if (ray_step_signs_[i] == 0) {
+        t_to_next_boundary_[i] = std::numeric_limits<FloatingPoint>::max();
+        t_step_size_[i] = 0.0f;
+        continue;
+      }
+
+      const FloatingPoint distance_to_boundary =
+          static_cast<FloatingPoint>(std::max(0, ray_step_signs_[i])) -
+          start_scaled_shifted[i];
+      t_to_next_boundary_[i] = distance_to_boundary / ray_scaled[i];
+      t_step_size_[i] = ray_step_signs_[i] / ray_scaled[i];
+    }
+
+    curr_local_idx_ = voxel_indexer_.getLocalVoxelIndex(curr_index_);
+    curr_linear_idx_ =
+        static_cast<int64_t>(voxel_indexer_.getLinearIndex(curr_index_));
+    linear_strides_ = LongIndex(1, voxels_per_side_,
+                                int64_t(voxels_per_side_) * voxels_per_side_);
+  }
+
+  static inline int signum(FloatingPoint x) {
+    return (x == 0) ? 0 : (x < 0) ? -1 : 1;
+  }
+
+  const VoxelIndexer &voxel_indexer_;
+  const IndexElement voxels_per_side_;
+
+  GlobalIndex curr_index_;
+  VoxelIndex curr_local_idx_;
+  int64_t curr_linear_idx_;
+  LongIndex linear_strides_;
+
+  AnyIndex ray_step_signs_;
+  Ray t_to_next_boundary_;
+  Ray t_step_size_;
+
+  int64_t current_step_;
+  int64_t ray_length_in_steps_;
+};
+
+#endif // TSDF_PLUSPLUS_INTEGRATOR_BLOCK_RAY_CASTER_H_
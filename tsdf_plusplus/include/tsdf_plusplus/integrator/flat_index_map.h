@@ -0,0 +1,117 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_INTEGRATOR_FLAT_INDEX_MAP_H_
+#define TSDF_PLUSPLUS_INTEGRATOR_FLAT_INDEX_MAP_H_
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <voxblox/core/common.h>
+
+using namespace voxblox;
+
+// Map from grid indices to dense uint32_t values, e.g. positions in a
+// vector, with open addressing and linear probing. Clearing it keeps its
+// capacity, such that a map refilled with about as many indices every frame
+// stops allocating once it has grown. Only supports insertion, lookup and
+// clearing.
+// NOT thread safe.
+template <typename IndexType, typename IndexHash>
+class FlatIndexMap {
+public:
+  static constexpr uint32_t kNotFound = std::numeric_limits<uint32_t>::max();
+
+  FlatIndexMap() : slots_(kInitialCapacity), mask_(kInitialCapacity - 1u) {}
+
+  inline size_t size() const { return size_; }
+
+  inline bool empty() const { return size_ == 0u; }
+
+  // Returns the value stored at index. If the index is not in the map yet,
+  // value is stored and returned.
+  inline uint32_t insert(const IndexType &index, uint32_t value) {
+    if ((size_ + 1u) * kMaxLoadDenominator >
+        slots_.size() * kMaxLoadNumerator) {
+      rehash(2u * slots_.size());
+    }
+    return insertWithoutRehash(index, value);
+  }
+
+  // Returns kNotFound if index is not in the map.
+  inline uint32_t find(const IndexType &index) const {
+    for (size_t slot_idx = getHomeSlot(index);;
+         slot_idx = (slot_idx + 1u) & mask_) {
+      const Slot &slot = slots_[slot_idx];
+      if (slot.value == kNotFound || slot.index == index) {
+        return slot.value;
+      }
+    }
+  }
+
+  void clear() {
+    if (size_ > 0u) {
+      std::fill(slots_.begin(), slots_.end(), Slot());
+      size_ = 0u;
+    }
+  }
+
+protected:
+  static constexpr size_t kInitialCapacity = 64u;
+
+  // Maximum fill ratio of the map before it grows, linear probing degrades
+  // quickly beyond one half.
+  static constexpr size_t kMaxLoadNumerator = 1u;
+  static constexpr size_t kMaxLoadDenominator = 2u;
+
+  struct Slot {
+    IndexType index = IndexType::Zero();
+    uint32_t value = kNotFound;
+  };
+
+  inline size_t getHomeSlot(const IndexType &index) const {
+    // Fibonacci hashing, the index hashes are poorly mixed in the low bits.
+    const uint64_t hash = static_cast<uint64_t>(IndexHash()(index));
+    return static_cast<size_t>((hash * 0x9e3779b97f4a7c15u) >> 32u) & mask_;
+  }
+
+  inline uint32_t insertWithoutRehash(const IndexType &index,
+                                      uint32_t value) {
+    for (size_t slot_idx = getHomeSlot(index);;
+         slot_idx = (slot_idx + 1u) & mask_) {
+      Slot &slot = slots_[slot_idx];
+      if (slot.value == kNotFound) {
+        slot.index = index;
+        slot.value = value;
+        ++size_;
+        return value;
+      }
+      if (slot.index == index) {
+        return slot.value;
+      }
+    }
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+    mask_ = capacity - 1u;
+    size_ = 0u;
+
+    for (const Slot &slot : old_slots) {
+      if (slot.value != kNotFound) {
+        insertWithoutRehash(slot.index, slot.value);
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t mask_;
+  size_t size_ = 0u;
+};
+
+template <typename IndexType, typename IndexHash>
+constexpr uint32_t FlatIndexMap<IndexType, IndexHash>::kNotFound;
+
+#endif // TSDF_PLUSPLUS_INTEGRATOR_FLAT_INDEX_MAP_H_
@@ -4,8 +4,10 @@
 #ifndef TSDF_PLUSPLUS_INTEGRATOR_INTEGRATOR_H_
 #define TSDF_PLUSPLUS_INTEGRATOR_INTEGRATOR_H_
 
+#include <atomic>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include <voxblox/core/common.h>
 #include <voxblox/integrator/integrator_utils.h>
@@ -13,10 +15,27 @@
 
 #include "tsdf_plusplus/core/map.h"
 #include "tsdf_plusplus/core/segment.h"
+#include "tsdf_plusplus/core/voxel_indexer.h"
+#include "tsdf_plusplus/integrator/block_ray_caster.h"
+#include "tsdf_plusplus/integrator/ray_bundles.h"
+#include "tsdf_plusplus/integrator/sensor_model.h"
+#include "tsdf_plusplus/integrator/voxel_bitmask.h"
+#include "tsdf_plusplus/integrator/worker_pool.h"
 
 using namespace voxblox;
 
-typedef std::map<Segment *, size_t> SegmentHistogram;
+// Number of points of a segment falling into voxels where an object is
+// active.
+struct SegmentOverlap {
+  ObjectID object_id;
+  Segment *segment;
+  size_t count;
+};
+
+// Overlaps of all the segments of a frame, kept as a flat list rather than
+// nested maps such that a reused list does not allocate once it has grown to
+// the size of a typical frame.
+typedef std::vector<SegmentOverlap> SegmentOverlapList;
 
 class Integrator {
 public:
@@ -35,10 +54,23 @@ public:
     bool use_sparsity_compensation_factor = false;
     float sparsity_compensation_factor = 1.0f;
 
+    // Weighting of the points by their depth. Options: "inverse_square",
+    // "constant" (same as use_const_weight), "rgbd". See SensorModel.
+    std::string sensor_model = "inverse_square";
+
+    // If false, the colors of the points are neither blended nor stored, and
+    // segments may come without colors.
+    bool integrate_color = true;
+
     size_t integrator_threads = std::thread::hardware_concurrency();
 
-    // ThreadSafeInfex mode results in rays being integrated
-    // in sorted or mixed order. Options: "mixed", "sorted"
+    // Segments with at least this many points spread their rays over all the
+    // integrator_threads. Smaller segments are instead integrated
+    // concurrently, one per thread. Set to 0 to always use the former.
+    size_t large_segment_min_points = 10000u;
+
+    // Has no effect, rays are bundled by the voxel they end in before being
+    // integrated. Kept such that existing configs still load.
     std::string integration_order_mode = "mixed";
 
     /// Merge integrator specific
@@ -49,26 +81,62 @@ public:
 
   // Compute the pairwise overlap (expressed as the number of points) between
   // a segment in the current frame and the corresponding objects in the map.
-  void computeObjectOverlap(
-      Segment *segment,
-      std::map<ObjectID, SegmentHistogram> *object_segment_overlap);
+  // The overlaps of the segment are appended to segment_overlaps.
+  void computeObjectOverlap(Segment *segment,
+                            SegmentOverlapList *segment_overlaps);
 
   // Assign to each segment either the object_id of one of the objects
   // in the map it overlaps with, or a new, previously unseen object_id.
-  void
-  assignObjectIds(std::vector<Segment *> *current_frame_segments,
-                  std::map<ObjectID, SegmentHistogram> *object_segment_overlap,
-                  std::map<ObjectID, Segment *> *object_merged_segments);
+  // Segments assigned the same object_id are merged into the first of them,
+  // merged_segments receives one segment per object_id. segment_overlaps is
+  // consumed in the process.
+  void assignObjectIds(std::vector<Segment *> *current_frame_segments,
+                       SegmentOverlapList *segment_overlaps,
+                       std::vector<Segment *> *merged_segments);
 
   void integrateSegment(const Segment &segment);
 
+  // Integrates all the segments of a frame. Large segments are integrated
+  // one after the other, the remaining ones concurrently.
+  void integrateSegments(const std::vector<Segment *> &segments);
+
 protected:
-  // Returns a new unique object_id, that has not been previously
-  // used, to initialize new objects in the map.
-  inline ObjectID getFreshObjectId() {
-    CHECK_LT(*highest_object_id_, std::numeric_limits<ObjectID>::max());
-    return ++(*highest_object_id_);
-  }
+  // Configuration flags resolved at compile time in the voxel update kernel.
+  // A kernel is instantiated for each combination of flags and the one
+  // matching the config is selected once per segment, such that the
+  // per-voxel code does not branch on the config.
+  // The measurement weights are looked up in sensor_model_ instead.
+  enum KernelFlag : unsigned {
+    kAntiGrazing = 1u << 0,
+    kNoColor = 1u << 1,
+  };
+  static constexpr unsigned kNumKernels = 1u << 2;
+
+  // Working buffers of one integration thread, kept across segments and
+  // frames and cleared before reuse such that they only allocate while
+  // growing.
+  struct ThreadBuffers {
+    explicit ThreadBuffers(size_t voxels_per_side)
+        : endpoint_mask(voxels_per_side) {}
+
+    // Rays ending within the truncation range and clearing rays.
+    RayBundles voxel_bundles;
+    RayBundles clear_bundles;
+
+    // Set of the voxels in which rays end, only
+    // built and queried when anti-grazing is enabled.
+    VoxelBitmask endpoint_mask;
+
+    BlockRayCaster::VoxelRun voxel_run;
+  };
+
+  // Tabulated weighting corresponding to config.
+  static SensorModel::Config getSensorModelConfig(const Config &config,
+                                                  float voxel_size);
+
+  // Returns an object_id that is not in use, to initialize new objects in
+  // the map.
+  inline ObjectID getFreshObjectId() { return map_->getFreshObjectId(); }
 
   // Thread safe.
   inline bool isPointValid(const Point &point_C, bool *is_clearing) const {
@@ -89,71 +157,144 @@ protected:
     }
   }
 
-  void increaseOverlapCount(
-      const ObjectID object_id, Segment *segment, size_t count,
-      std::map<ObjectID, SegmentHistogram> *object_segment_overlap);
+  // The overlaps of segment must be the last ones of segment_overlaps.
+  void increaseOverlapCount(const ObjectID object_id, Segment *segment,
+                            size_t count, SegmentOverlapList *segment_overlaps);
+
+  // Returns the largest overlap left in segment_overlaps.
+  bool nextSegmentObjectPair(const SegmentOverlapList &segment_overlaps,
+                             SegmentOverlap *segment_object_pair);
+
+  // Selects the kernel instantiation matching kernel_flags_,
+  // starting from kFlags and going down.
+  // thread_idx selects the buffers used by concurrent kernels.
+  template <unsigned kFlags>
+  void dispatchIntegrateSegment(const Segment &segment, bool concurrent,
+                                size_t thread_idx);
+
+  template <unsigned kFlags>
+  void integrateSegmentKernel(const Segment &segment);
+
+  // Single threaded kernel used when several segments are integrated at once.
+  // The allocated blocks are not merged into the layers, the caller has to
+  // call updateLayerWithStoredBlocks once all segments are integrated.
+  template <unsigned kFlags>
+  void integrateSegmentKernelConcurrent(const Segment &segment,
+                                        ThreadBuffers *buffers);
+
+  void integrateSegmentsConcurrent(const std::vector<Segment *> &segments,
+                                   std::atomic<size_t> *next_segment_idx,
+                                   size_t thread_idx);
+
+  // Updates the observation statistics of the segment's object.
+  void recordObservation(const Segment &segment);
+
+  // Returns the object volume of the segment's object, allocating it at the
+  // resolution selected by the map from the extent of the segment if the
+  // object has not been observed before. Thread safe.
+  ObjectVolume *allocateObjectVolume(const Segment &segment);
+
+  // Truncation distance of the object, scaled along with its voxel size.
+  inline float getTruncationDistance(const ObjectVolume &object_volume) const {
+    return config_.truncation_distance *
+           static_cast<float>(1u << object_volume.getVoxelScaleShift());
+  }
 
-  bool nextSegmentObjectPair(
-      const std::map<ObjectID, SegmentHistogram> &object_segment_overlap,
-      const std::set<Segment *> &assigned_segments,
-      std::pair<Segment *, ObjectID> *segment_object_pair);
+  // Map voxels covered by the same object voxel must be updated under the
+  // same mutex, hence mutexes are looked up at the coarsest object scale.
+  inline GlobalIndex getMutexIndex(const GlobalIndex &global_voxel_idx) const {
+    return GlobalIndex(global_voxel_idx.x() >> mutex_index_shift_,
+                       global_voxel_idx.y() >> mutex_index_shift_,
+                       global_voxel_idx.z() >> mutex_index_shift_);
+  }
 
+  // Fills the bundles and, if anti_grazing, the endpoint mask of buffers.
   void bundleRays(const Transformation &T_G_C, const Pointcloud &points_C,
-                  ThreadSafeIndex *index_getter,
-                  LongIndexHashMapType<AlignedVector<size_t>>::type *voxel_map,
-                  LongIndexHashMapType<AlignedVector<size_t>>::type *clear_map);
-
-  void integrateRays(
-      const Transformation &T_G_C, const Pointcloud &points_C,
-      const Point centroid, const ObjectID &object_id,
-      const SemanticClass &semantic_class, const Colors &colors,
-      bool enable_anti_grazing, bool clearing_ray,
-      const LongIndexHashMapType<AlignedVector<size_t>>::type &voxel_map,
-      const LongIndexHashMapType<AlignedVector<size_t>>::type &clear_map);
-
-  void integrateVoxels(
-      const Transformation &T_G_C, const Pointcloud &points_C,
-      const Point centroid, const ObjectID &object_id,
-      const SemanticClass &semantic_class, const Colors &colors,
-      bool enable_anti_grazing, bool clearing_ray,
-      const LongIndexHashMapType<AlignedVector<size_t>>::type &voxel_map,
-      const LongIndexHashMapType<AlignedVector<size_t>>::type &clear_map,
-      size_t thread_idx);
-
-  void integrateVoxel(
-      const Transformation &T_G_C, const Pointcloud &points_C,
-      const Point centroid, const ObjectID &object_id,
-      const SemanticClass &semantic_class, const Colors &colors,
-      bool enable_anti_grazing, bool clearing_ray,
-      const std::pair<GlobalIndex, AlignedVector<size_t>> &kv,
-      const LongIndexHashMapType<AlignedVector<size_t>>::type &voxel_map);
+                  bool anti_grazing, ThreadBuffers *buffers);
+
+  // Integrates the bundles of buffers on num_threads threads of the worker
+  // pool, or on the calling thread alone with the voxel run of buffers.
+  template <unsigned kFlags>
+  void integrateRays(const Transformation &T_G_C, const Pointcloud &points_C,
+                     const Point centroid, const ObjectID &object_id,
+                     const SemanticClass &semantic_class, const Colors &colors,
+                     const float truncation_distance, ThreadBuffers *buffers,
+                     size_t num_threads);
+
+  template <unsigned kFlags>
+  void integrateVoxels(const Transformation &T_G_C, const Pointcloud &points_C,
+                       const Point centroid, const ObjectID &object_id,
+                       const SemanticClass &semantic_class,
+                       const Colors &colors, const float truncation_distance,
+                       const RayBundles &voxel_bundles,
+                       const VoxelBitmask &endpoint_mask,
+                       BlockRayCaster::VoxelRun *voxel_run, size_t thread_idx,
+                       size_t num_threads);
+
+  template <unsigned kFlags>
+  void integrateVoxel(const Transformation &T_G_C, const Pointcloud &points_C,
+                      const Point centroid, const ObjectID &object_id,
+                      const SemanticClass &semantic_class,
+                      const Colors &colors, const float truncation_distance,
+                      const RayBundles &voxel_bundles, size_t bundle_idx,
+                      const VoxelBitmask &endpoint_mask,
+                      BlockRayCaster::VoxelRun *voxel_run);
+
+  // Clearing rays, i.e. rays longer than max_ray_length_m, only carve free
+  // space into the map. They are traversed block by block skipping the blocks
+  // that have never been observed, and apply the lighter clearMOVoxel update.
+  template <unsigned kFlags>
+  void integrateClearingRays(const Transformation &T_G_C,
+                             const Pointcloud &points_C,
+                             const ThreadBuffers &buffers, size_t num_threads);
+
+  template <unsigned kFlags>
+  void clearVoxels(const Transformation &T_G_C, const Pointcloud &points_C,
+                   const RayBundles &clear_bundles,
+                   const VoxelBitmask &endpoint_mask, size_t thread_idx,
+                   size_t num_threads);
+
+  template <unsigned kFlags>
+  void clearRay(const Transformation &T_G_C, const Point &point_C,
+                const float weight, const VoxelBitmask &endpoint_mask);
 
   // Thread safe.
-  // Will return a pointer to a voxel located at global_voxel_idx in the map
-  // layer. Takes in the last_block_idx and last_block to prevent unneeded map
-  // lookups. If this voxel belongs to a block that has not been allocated, a
-  // block in temp_block_map_ is created/accessed and a voxel from this map is
-  // returned instead. Unlike the layer, accessing temp_block_map_ is controlled
-  // via a mutex allowing it to grow during integration. These temporary blocks
-  // can be merged into the layer later by calling updateLayerWithStoredBlocks.
-  MOVoxel *allocateStorageAndGetVoxelPtr(const GlobalIndex &global_voxel_idx,
-                                         Block<MOVoxel>::Ptr *last_block,
-                                         BlockIndex *last_block_idx);
+  // Will return a pointer to the block located at block_idx in the map layer.
+  // If this block has not been allocated, a block in temp_block_map_ is
+  // created/accessed and returned instead. Unlike the layer, accessing
+  // temp_block_map_ is controlled via a mutex allowing it to grow during
+  // integration. These temporary blocks can be merged into the layer later by
+  // calling updateLayerWithStoredBlocks.
+  Block<MOVoxel> *allocateStorageAndGetBlockPtr(const BlockIndex &block_idx);
 
   // Merges temporarily stored blocks into the main layer.
   // NOT thread safe, see allocateStorageAndGetVoxelPtr for more details.
   void updateLayerWithStoredBlocks();
 
-  // Updates mo_voxel, thread safe.
+  // Updates mo_voxel, thread safe. truncation_distance is the one of the
+  // object_id volume. last_tsdf_voxel is the object voxel updated last along
+  // the ray, a ray crossing several map voxels of a coarser object voxel
+  // only updates it once.
+  template <unsigned kFlags>
   void updateMOVoxel(const Point centroid, const SemanticClass &semantic_class,
                      const Point &origin, const Point &point_G,
                      const ObjectID &object_id,
                      const GlobalIndex &global_voxel_idx, const Color &color,
-                     const float weight, MOVoxel *mo_voxel,
+                     const float weight, const float truncation_distance,
+                     MOVoxel *mo_voxel,
                      ObjectVolume **last_object_volume,
                      ObjectID *last_object_id,
-                     Block<TsdfVoxel>::Ptr *last_tsdf_block,
-                     BlockIndex *last_tsdf_block_idx);
+                     Block<TsdfVoxel> **last_tsdf_block,
+                     BlockIndex *last_tsdf_block_idx,
+                     TsdfVoxel **last_tsdf_voxel);
+
+  // Carves free space into the object active at mo_voxel, thread safe.
+  void clearMOVoxel(const GlobalIndex &global_voxel_idx, const float weight,
+                    MOVoxel *mo_voxel, ObjectVolume **last_object_volume,
+                    ObjectID *last_object_id,
+                    Block<TsdfVoxel> **last_tsdf_block,
+                    BlockIndex *last_tsdf_block_idx,
+                    TsdfVoxel **last_tsdf_voxel);
 
   // Thread safe.
   // Figure out whether the voxel is behind or in front of the surface.
@@ -164,16 +305,20 @@ protected:
                         const Point &voxel_center) const;
 
   // Thread safe.
-  float getVoxelWeight(const Point &point_C) const;
+  inline float getVoxelWeight(const Point &point_C) const {
+    return sensor_model_.getDepthWeight(point_C.z());
+  }
 
   Config config_;
 
+  SensorModel sensor_model_;
+
+  // Combination of KernelFlag values corresponding to config_.
+  unsigned kernel_flags_;
+
   // Map containing the global map layer and the object volumes.
   Map *map_;
 
-  // Reference to the highest object_id generated in the map.
-  ObjectID *highest_object_id_;
-
   // Cached map config.
   float voxel_size_;
   size_t voxels_per_side_;
@@ -181,11 +326,15 @@ protected:
 
   // Derived types.
   float voxel_size_inv_;
-  float voxels_per_side_inv_;
   float block_size_inv_;
 
+  VoxelIndexer voxel_indexer_;
+
+  // Largest voxel scale shift of the object volumes, see getMutexIndex.
+  unsigned int mutex_index_shift_;
+
   // Temporary storage and mutex for blocks that need
-  // to be created while integrating a segment.
+  // to be created while integrating one or more segments.
   Layer<MOVoxel>::BlockHashMap temp_block_map_;
   std::mutex temp_block_mutex_;
 
@@ -199,6 +348,16 @@ protected:
   // chance of two threads needing the same lock for unrelated voxels is
   // (num_threads / (2^n)). For 8 threads and 12 bits this gives 0.2%.
   ApproxHashArray<12, std::mutex, GlobalIndex, LongIndexHash> mutexes_;
+
+  // Runs the multithreaded parts of the integration, with
+  // config_.integrator_threads threads.
+  std::unique_ptr<WorkerPool> worker_pool_;
+
+  // Buffers of each thread of worker_pool_, indexed by thread.
+  std::vector<std::unique_ptr<ThreadBuffers>> thread_buffers_;
+
+  // Segments of the frame being integrated concurrently.
+  std::vector<Segment *> small_segments_;
 };
 
 #endif // TSDF_PLUSPLUS_INTEGRATOR_INTEGRATOR_H_
@@ -0,0 +1,109 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_INTEGRATOR_RAY_BUNDLES_H_
+#define TSDF_PLUSPLUS_INTEGRATOR_RAY_BUNDLES_H_
+
+#include <utility>
+#include <vector>
+
+#include <voxblox/core/common.h>
+
+#include "tsdf_plusplus/integrator/flat_index_map.h"
+
+using namespace voxblox;
+
+// Points of a pointcloud bundled by the voxel they end in, such that each
+// voxel is integrated with a single merged ray. Replaces a hash map from
+// voxels to vectors of point indices: the bundles are stored in flat
+// vectors that keep their capacity when cleared, so bundling the segments of
+// a frame does not allocate once the buffers have grown.
+// NOT thread safe while being built, thread safe to read once finalized.
+class RayBundles {
+public:
+  // Indices of the points of a bundle, in the order they were added.
+  class PointRange {
+  public:
+    PointRange(const size_t *begin, const size_t *end)
+        : begin_(begin), end_(end) {}
+
+    inline const size_t *begin() const { return begin_; }
+    inline const size_t *end() const { return end_; }
+    inline bool empty() const { return begin_ == end_; }
+
+  protected:
+    const size_t *begin_;
+    const size_t *end_;
+  };
+
+  // Number of bundles, i.e. of distinct voxels.
+  inline size_t size() const { return voxel_indices_.size(); }
+
+  inline bool empty() const { return voxel_indices_.empty(); }
+
+  void clear() {
+    bundle_indices_.clear();
+    voxel_indices_.clear();
+    added_points_.clear();
+    offsets_.clear();
+    point_indices_.clear();
+  }
+
+  // Adds the point at point_idx to the bundle of the voxel it ends in.
+  inline void add(const GlobalIndex &voxel_idx, size_t point_idx) {
+    const uint32_t num_bundles = static_cast<uint32_t>(voxel_indices_.size());
+    const uint32_t bundle_idx = bundle_indices_.insert(voxel_idx, num_bundles);
+    if (bundle_idx == num_bundles) {
+      voxel_indices_.push_back(voxel_idx);
+    }
+    added_points_.emplace_back(point_idx, bundle_idx);
+  }
+
+  // Groups the added points by bundle, must be called once all points have
+  // been added and before the bundles are read.
+  void finalize() {
+    // Counting sort of the points by bundle, offsets_ first holds the number
+    // of points of each bundle, then the position of its first point.
+    offsets_.assign(voxel_indices_.size() + 1u, 0u);
+    for (const std::pair<size_t, uint32_t> &added_point : added_points_) {
+      ++offsets_[added_point.second + 1u];
+    }
+    for (size_t bundle_idx = 1u; bundle_idx < offsets_.size(); ++bundle_idx) {
+      offsets_[bundle_idx] += offsets_[bundle_idx - 1u];
+    }
+
+    point_indices_.resize(added_points_.size());
+    for (const std::pair<size_t, uint32_t> &added_point : added_points_) {
+      point_indices_[offsets_[added_point.second]++] = added_point.first;
+    }
+
+    // Each offset has moved on to the first point of the next bundle.
+    for (size_t bundle_idx = offsets_.size() - 1u; bundle_idx > 0u;
+         --bundle_idx) {
+      offsets_[bundle_idx] = offsets_[bundle_idx - 1u];
+    }
+    offsets_[0] = 0u;
+  }
+
+  inline const GlobalIndex &getVoxelIndex(size_t bundle_idx) const {
+    return voxel_indices_[bundle_idx];
+  }
+
+  inline PointRange getPoints(size_t bundle_idx) const {
+    return PointRange(point_indices_.data() + offsets_[bundle_idx],
+                      point_indices_.data() + offsets_[bundle_idx + 1u]);
+  }
+
+protected:
+  FlatIndexMap<GlobalIndex, LongIndexHash> bundle_indices_;
+  std::vector<GlobalIndex> voxel_indices_;
+
+  // Point index and bundle index of the points, in the order they were added.
+  std::vector<std::pair<size_t, uint32_t>> added_points_;
+
+  // Points of bundle i are point_indices_[offsets_[i], offsets_[i + 1]).
+  std::vector<size_t> offsets_;
+  std::vector<size_t> point_indices_;
+};
+
+#endif // TSDF_PLUSPLUS_INTEGRATOR_RAY_BUNDLES_H_
@@ -0,0 +1,117 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_INTEGRATOR_SENSOR_MODEL_H_
+#define TSDF_PLUSPLUS_INTEGRATOR_SENSOR_MODEL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <voxblox/core/common.h>
+
+using namespace voxblox;
+
+// Weighting of the measurements integrated into the map, tabulated once at
+// construction. The weight of a point is looked up from its depth, and the
+// factor applied to it at a voxel from the SDF of the voxel normalized by the
+// truncation distance. Lookups clamp their argument into the table instead
+// of branching on it.
+class SensorModel {
+public:
+  enum class DepthModel {
+    // All points weigh the same, e.g. for noise free synthetic depth.
+    kConstant,
+    // 1/z^2, the voxblox default.
+    kInverseSquare,
+    // Inverse variance of the axial noise of structured light RGB-D
+    // cameras, sigma(z) = a + b * (z - c)^2, normalized to 1 at 1 m.
+    kRgbdNoise,
+  };
+
+  struct Config {
+    DepthModel depth_model = DepthModel::kInverseSquare;
+
+    // Axial noise parameters of the kRgbdNoise model, defaults from Nguyen et
+    // al., "Modeling Kinect Sensor Noise for Improved 3D Reconstruction and
+    // Tracking".
+    float noise_a = 0.0012f;
+    float noise_b = 0.0019f;
+    float noise_c = 0.4f;
+
+    // Depth range covered by the depth table. Points closer than min_depth
+    // get the weight at min_depth. The weight of points beyond max_depth,
+    // e.g. the endpoints of clearing rays, is computed without the table.
+    float min_depth = 0.1f;
+    float max_depth = 5.0f;
+    size_t num_depth_bins = 2048u;
+
+    // Linearly drop the weight behind the surface, starting at dropoff_epsilon
+    // (relative to the truncation distance) and reaching 0 at the truncation
+    // distance.
+    bool use_weight_dropoff = true;
+    float dropoff_epsilon = 0.1f;
+
+    // Scale the weight of voxels within the truncation band, see
+    // Integrator::Config.
+    bool use_sparsity_compensation = false;
+    float sparsity_compensation_factor = 1.0f;
+
+    size_t num_sdf_bins = 256u;
+  };
+
+  explicit SensorModel(const Config &config);
+
+  // Returns false if name is none of "constant", "inverse_square", "rgbd".
+  static bool getDepthModelFromString(const std::string &name,
+                                      DepthModel *depth_model);
+
+  // Weight of a point at depth z in the camera frame. Linearly interpolated
+  // between the table entries, as 1/z^2 varies quickly close to the camera.
+  inline float getDepthWeight(float z) const {
+    const float depth = std::abs(z);
+    if (depth > max_depth_) {
+      return computeDepthWeight(depth);
+    }
+
+    const float t = std::min(
+        std::max((depth - min_depth_) * depth_bins_per_m_, 0.0f),
+        max_depth_bin_);
+    const size_t bin = static_cast<size_t>(t);
+    const float alpha = t - static_cast<float>(bin);
+    return depth_weights_[bin] +
+           alpha * (depth_weights_[bin + 1u] - depth_weights_[bin]);
+  }
+
+  // Factor applied to the weight at a voxel, given its SDF divided by the
+  // truncation distance. The last table entry holds the factor of the
+  // voxels beyond the truncation band.
+  inline float getSdfFactor(float normalized_sdf) const {
+    const float t = std::min(
+        std::max((normalized_sdf + 1.0f) * sdf_bins_per_unit_, 0.0f),
+        num_sdf_bins_);
+    return sdf_factors_[static_cast<size_t>(t)];
+  }
+
+protected:
+  float computeDepthWeight(float z) const;
+
+  float computeSdfFactor(float normalized_sdf) const;
+
+  Config config_;
+
+  float min_depth_;
+  float max_depth_;
+  float depth_bins_per_m_;
+  // Largest argument of the depth table interpolation, just below its last
+  // entry such that bin + 1 stays in the table.
+  float max_depth_bin_;
+  std::vector<float> depth_weights_;
+
+  float sdf_bins_per_unit_;
+  float num_sdf_bins_;
+  std::vector<float> sdf_factors_;
+};
+
+#endif // TSDF_PLUSPLUS_INTEGRATOR_SENSOR_MODEL_H_
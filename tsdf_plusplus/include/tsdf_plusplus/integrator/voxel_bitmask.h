@@ -0,0 +1,96 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_INTEGRATOR_VOXEL_BITMASK_H_
+#define TSDF_PLUSPLUS_INTEGRATOR_VOXEL_BITMASK_H_
+
+#include <vector>
+
+#include <voxblox/core/common.h>
+
+#include "tsdf_plusplus/core/voxel_indexer.h"
+#include "tsdf_plusplus/integrator/flat_index_map.h"
+
+using namespace voxblox;
+
+// Set of global voxel indices stored as one bitmask per block. Consecutive
+// queries along a ray mostly fall into the same block, so by caching the
+// block of the previous query a hash lookup is only needed when the ray
+// enters a new block. The bitmasks are stored in a flat vector which keeps
+// its capacity when cleared, a reused set does not allocate once grown.
+class VoxelBitmask {
+public:
+  // Block looked up by the previous query.
+  struct Cache {
+    bool valid = false;
+    BlockIndex block_idx;
+    const uint64_t *block_words = nullptr;
+  };
+
+  explicit VoxelBitmask(size_t voxels_per_side)
+      : voxel_indexer_(voxels_per_side),
+        num_words_((voxels_per_side * voxels_per_side * voxels_per_side +
+                    kBitsPerWord - 1u) /
+                   kBitsPerWord) {}
+
+  // NOT thread safe.
+  inline void insert(const GlobalIndex &global_voxel_idx) {
+    const BlockIndex block_idx = voxel_indexer_.getBlockIndex(global_voxel_idx);
+
+    const uint32_t num_blocks = static_cast<uint32_t>(block_numbers_.size());
+    const uint32_t block_number = block_numbers_.insert(block_idx, num_blocks);
+    if (block_number == num_blocks) {
+      words_.resize(words_.size() + num_words_, 0u);
+    }
+
+    const size_t bit_idx = voxel_indexer_.getLinearIndex(global_voxel_idx);
+    words_[block_number * num_words_ + bit_idx / kBitsPerWord] |=
+        uint64_t(1u) << (bit_idx % kBitsPerWord);
+  }
+
+  // Thread safe as long as no insertion happens concurrently.
+  inline bool contains(const GlobalIndex &global_voxel_idx,
+                       Cache *cache) const {
+    const BlockIndex block_idx = voxel_indexer_.getBlockIndex(global_voxel_idx);
+
+    if (!cache->valid || block_idx != cache->block_idx) {
+      const uint32_t block_number = block_numbers_.find(block_idx);
+      cache->block_words =
+          (block_number != BlockNumberMap::kNotFound)
+              ? words_.data() + block_number * num_words_
+              : nullptr;
+      cache->block_idx = block_idx;
+      cache->valid = true;
+    }
+
+    if (cache->block_words == nullptr) {
+      return false;
+    }
+
+    const size_t bit_idx = voxel_indexer_.getLinearIndex(global_voxel_idx);
+    return (cache->block_words[bit_idx / kBitsPerWord] >>
+            (bit_idx % kBitsPerWord)) &
+           1u;
+  }
+
+  // NOT thread safe.
+  void clear() {
+    block_numbers_.clear();
+    words_.clear();
+  }
+
+protected:
+  static constexpr size_t kBitsPerWord = 64u;
+
+  typedef FlatIndexMap<BlockIndex, AnyIndexHash> BlockNumberMap;
+
+  VoxelIndexer voxel_indexer_;
+  size_t num_words_;
+
+  // The bitmask of the n-th inserted block is made of
+  // words_[n * num_words_, (n + 1) * num_words_).
+  BlockNumberMap block_numbers_;
+  std::vector<uint64_t> words_;
+};
+
+#endif // TSDF_PLUSPLUS_INTEGRATOR_VOXEL_BITMASK_H_
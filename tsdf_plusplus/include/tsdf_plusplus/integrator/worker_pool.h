@@ -0,0 +1,74 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_INTEGRATOR_WORKER_POOL_H_
+#define TSDF_PLUSPLUS_INTEGRATOR_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+// Threads started once and reused to run the parallel parts of the
+// integration, such that integrating a frame does not spawn threads.
+// The calling thread takes part in each task as thread 0.
+// NOT reentrant, a task must not run another task on the same pool.
+class WorkerPool {
+public:
+  // Starts num_threads - 1 worker threads.
+  explicit WorkerPool(size_t num_threads);
+
+  ~WorkerPool();
+
+  inline size_t getNumThreads() const { return workers_.size() + 1u; }
+
+  // Calls task(thread_idx) for each thread_idx in [0, num_threads)
+  // concurrently and returns once all calls have returned.
+  template <typename Task>
+  void run(size_t num_threads, const Task &task) {
+    CHECK_GT(num_threads, 0u);
+    CHECK_LE(num_threads, getNumThreads());
+
+    // The task is wrapped on the stack, it lives until all threads are done.
+    const TaskWrapper<Task> task_wrapper(task);
+    runTask(num_threads, task_wrapper);
+  }
+
+protected:
+  struct TaskBase {
+    virtual ~TaskBase() = default;
+    virtual void operator()(size_t thread_idx) const = 0;
+  };
+
+  template <typename Task> struct TaskWrapper : public TaskBase {
+    explicit TaskWrapper(const Task &task) : task(task) {}
+
+    void operator()(size_t thread_idx) const override { task(thread_idx); }
+
+    const Task &task;
+  };
+
+  void runTask(size_t num_threads, const TaskBase &task);
+
+  void workerLoop(size_t thread_idx);
+
+  std::vector<std::thread> workers_;
+
+  // Protects all the members below.
+  std::mutex mutex_;
+  std::condition_variable task_condition_;
+  std::condition_variable done_condition_;
+
+  const TaskBase *task_ = nullptr;
+  size_t task_num_threads_ = 0u;
+  // Incremented for each task, such that workers tell a new task apart.
+  uint64_t task_generation_ = 0u;
+  // Number of worker threads still running the current task.
+  size_t num_running_ = 0u;
+  bool stop_ = false;
+};
+
+#endif // TSDF_PLUSPLUS_INTEGRATOR_WORKER_POOL_H_
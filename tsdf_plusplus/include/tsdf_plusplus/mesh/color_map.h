@@ -16,6 +16,9 @@ class ColorMap {
 
   void getColor(const ObjectID& object_id, voxblox::Color* color);
 
+  // Forgets the color of object_id, a new one is drawn on the next query.
+  void removeColor(const ObjectID& object_id);
+
  protected:
   voxblox::Color randomColor();
 
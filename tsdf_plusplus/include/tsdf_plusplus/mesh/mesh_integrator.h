@@ -51,7 +51,14 @@ public:
 
   // Generates a mesh from the map_layer, returns a boolean
   // whether parts of the layer had to be re-meshed.
-  bool generateMesh(bool only_mesh_updated_blocks, bool clear_updated_flag);
+  // If meshed_blocks is set, the re-meshed blocks are appended to it.
+  bool generateMesh(bool only_mesh_updated_blocks, bool clear_updated_flag,
+                    BlockIndexList *meshed_blocks = nullptr);
+
+  // To be called when an object is removed from the map.
+  inline void removeObject(const ObjectID &object_id) {
+    color_map_.removeColor(object_id);
+  }
 
 protected:
   void initFromLayer(const Layer<MOVoxel> &map_layer);
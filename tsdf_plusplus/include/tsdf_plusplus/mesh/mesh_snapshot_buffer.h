@@ -0,0 +1,49 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_MESH_MESH_SNAPSHOT_BUFFER_H_
+#define TSDF_PLUSPLUS_MESH_MESH_SNAPSHOT_BUFFER_H_
+
+#include <memory>
+#include <mutex>
+
+#include <voxblox/core/common.h>
+#include <voxblox/mesh/mesh_layer.h>
+
+using namespace voxblox;
+
+// Hands over immutable per-block mesh snapshots from the mesher to a consumer,
+// e.g. a renderer. The mesher publishes copies of the blocks it re-meshed, the
+// consumer takes all the snapshots published since its last call and swaps
+// them into its own copy of the mesh. The lock is only held to merge or swap
+// the pending snapshots, never while meshing or rendering, so neither side
+// waits for the other.
+class MeshSnapshotBuffer {
+public:
+  typedef std::shared_ptr<const Mesh> MeshSnapshot;
+  typedef AnyIndexHashMapType<MeshSnapshot>::type MeshSnapshotMap;
+
+  // Copies the meshes of block_indices from the mesh layer. Snapshots of the
+  // same blocks not yet taken by the consumer are replaced.
+  // The mesh layer must not be modified during the call.
+  void publishBlocks(const MeshLayer &mesh_layer,
+                     const BlockIndexList &block_indices);
+
+  // Marks blocks whose mesh was removed, they are taken as null snapshots.
+  void publishRemovedBlocks(const BlockIndexList &block_indices);
+
+  // Marks all blocks as removed, e.g. after the map was cleared.
+  void publishClear();
+
+  // Moves the pending snapshots into snapshots, returns false if there are
+  // none. If the map was cleared since the last call, *cleared is set and
+  // the consumer should drop all its blocks before applying the snapshots.
+  bool takeSnapshots(MeshSnapshotMap *snapshots, bool *cleared);
+
+protected:
+  std::mutex pending_mutex_;
+  MeshSnapshotMap pending_snapshots_;
+  bool pending_clear_ = false;
+};
+
+#endif // TSDF_PLUSPLUS_MESH_MESH_SNAPSHOT_BUFFER_H_
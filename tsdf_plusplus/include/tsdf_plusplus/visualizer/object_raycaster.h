@@ -0,0 +1,89 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_VISUALIZER_OBJECT_RAYCASTER_H_
+#define TSDF_PLUSPLUS_VISUALIZER_OBJECT_RAYCASTER_H_
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <voxblox/core/common.h>
+
+#include "tsdf_plusplus/core/map.h"
+#include "tsdf_plusplus/core/voxel_indexer.h"
+
+using namespace voxblox;
+
+// Renders object instance and depth images of the map on the CPU, by casting
+// one ray per pixel until it enters the surface of the object active in the
+// traversed voxels. The map is only read when taking a snapshot, renders
+// read the snapshot and may run while the map is being integrated.
+class ObjectRaycaster {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  struct Config {
+    size_t image_width = 640u;
+    size_t image_height = 480u;
+    // Pinhole intrinsics.
+    float fx = 525.0f;
+    float fy = 525.0f;
+    float cx = 319.5f;
+    float cy = 239.5f;
+    float max_depth = 10.0f;
+    float min_weight = 1e-4;
+    size_t render_threads = std::thread::hardware_concurrency();
+  };
+
+  // Map data read by a render from T_G_C. For each map block in the view
+  // frustum, holds the object of each voxel if the voxel lies behind the
+  // surface of its active object, i.e. a ray entering it hits the object,
+  // and EmptyID otherwise.
+  struct Snapshot {
+    Transformation T_G_C;
+    // Blocks without any surface voxel are left out.
+    AnyIndexHashMapType<std::vector<ObjectID>>::type block_object_ids;
+  };
+
+  ObjectRaycaster(const Config &config, std::shared_ptr<Map> map);
+
+  inline const Config &getConfig() const { return config_; }
+
+  // Copies the map data seen from the camera pose T_G_C into snapshot.
+  // The map must not be modified while the snapshot is taken.
+  void takeSnapshot(const Transformation &T_G_C, Snapshot *snapshot);
+
+  // Renders the snapshot into row-major images, without accessing the map.
+  // Pixels whose ray hits no surface have object id EmptyID and depth 0.
+  void render(const Snapshot &snapshot, std::vector<ObjectID> *object_ids,
+              std::vector<float> *depths) const;
+
+protected:
+  // Whether the block may be seen by a ray cast from the camera, tested on
+  // the bounding sphere of the block.
+  bool isBlockInFrustum(const Transformation &T_C_G,
+                        const BlockIndex &block_idx) const;
+
+  void renderRows(const Snapshot &snapshot, size_t thread_idx,
+                  std::vector<ObjectID> *object_ids,
+                  std::vector<float> *depths) const;
+
+  // Returns whether the ray from origin to ray_end hits a surface.
+  bool castRay(const Snapshot &snapshot, const Point &origin,
+               const Point &ray_end, ObjectID *object_id,
+               Point *hit_point_G) const;
+
+  Config config_;
+
+  // Map containing the TSDF++ global map layer and the object volumes.
+  std::shared_ptr<Map> map_;
+
+  // Cached map config.
+  FloatingPoint voxel_size_;
+  FloatingPoint voxel_size_inv_;
+  FloatingPoint block_size_;
+  VoxelIndexer voxel_indexer_;
+};
+
+#endif // TSDF_PLUSPLUS_VISUALIZER_OBJECT_RAYCASTER_H_
@@ -3,6 +3,7 @@
 
 #include "tsdf_plusplus/core/map.h"
 
+#include <limits>
 #include <shared_mutex>
 
 #include <voxblox/interpolator/interpolator.h>
@@ -10,15 +11,28 @@
 using namespace voxblox;
 
 Map::Map(const Config &config)
-    : config_(config),
+    : config_(config), voxel_indexer_(config.voxels_per_side),
       map_layer_(new Layer<MOVoxel>(config.voxel_size, config.voxels_per_side)),
       highest_object_id_(new ObjectID()) {
-  voxels_per_side_inv_ =
-      1.0f / static_cast<FloatingPoint>(config.voxels_per_side);
   block_size_ = config.voxel_size * config.voxels_per_side;
   object_volumes_.reset(new std::map<ObjectID, ObjectVolume *>());
 }
 
+void Map::insertMapBlock(
+    const std::pair<const BlockIndex, Block<MOVoxel>::Ptr> &block_pair) {
+  map_layer_->insertBlock(block_pair);
+  map_blocks_.insert(block_pair.first, block_pair.second.get());
+}
+
+Block<MOVoxel> *Map::allocateMapBlockPtrByIndex(const BlockIndex &block_idx) {
+  Block<MOVoxel> *block = map_blocks_.find(block_idx);
+  if (block == nullptr) {
+    block = map_layer_->allocateBlockPtrByIndex(block_idx).get();
+    map_blocks_.insert(block_idx, block);
+  }
+  return block;
+}
+
 ObjectVolume *Map::getObjectVolumePtrById(const ObjectID &object_id) {
   std::shared_lock<std::shared_timed_mutex> object_volumes_reader_lock(
       object_volumes_mutex_);
@@ -31,10 +45,21 @@ ObjectVolume *Map::getObjectVolumePtrById(const ObjectID &object_id) {
   }
 }
 
+unsigned int Map::selectVoxelScaleShift(const SemanticClass &semantic_class,
+                                        float extent) const {
+  if (semantic_class == BackgroundClass) {
+    return config_.background_voxel_scale_shift;
+  }
+  if (extent >= config_.large_object_min_extent) {
+    return config_.large_object_voxel_scale_shift;
+  }
+  return 0u;
+}
+
 ObjectVolume *
 Map::allocateObjectVolumePtrById(const Point centroid,
                                  const SemanticClass &semantic_class,
-                                 const ObjectID &object_id) {
+                                 const ObjectID &object_id, float extent) {
   std::lock_guard<std::shared_timed_mutex> object_volumes_writer_lock(
       object_volumes_mutex_);
 
@@ -45,7 +70,8 @@ Map::allocateObjectVolumePtrById(const Point centroid,
   }
 
   ObjectVolume *object_volume = new ObjectVolume(
-      config_.voxel_size, config_.voxels_per_side, centroid, semantic_class);
+      config_.voxel_size, config_.voxels_per_side,
+      selectVoxelScaleShift(semantic_class, extent), centroid, semantic_class);
   auto insert_status = object_volumes_->emplace(object_id, object_volume);
   CHECK(insert_status.second)
       << "Object volume " << object_id << " already exists when allocating.";
@@ -56,15 +82,12 @@ TsdfVoxel *Map::allocateStorageAndGetVoxelPtr(
     const Point centroid, const SemanticClass &semantic_class,
     const ObjectID &object_id, const GlobalIndex &global_voxel_idx,
     ObjectVolume **last_object_volume, ObjectID *last_object_id,
-    Block<TsdfVoxel>::Ptr *last_tsdf_block, BlockIndex *last_tsdf_block_idx) {
+    Block<TsdfVoxel> **last_tsdf_block, BlockIndex *last_tsdf_block_idx) {
   CHECK_NOTNULL(last_object_volume);
   CHECK_NOTNULL(last_object_id);
   CHECK_NOTNULL(last_tsdf_block);
   CHECK_NOTNULL(last_tsdf_block_idx);
 
-  const BlockIndex block_idx =
-      getBlockIndexFromGlobalVoxelIndex(global_voxel_idx, voxels_per_side_inv_);
-
   if ((object_id != *last_object_id) || (*last_object_volume == nullptr)) {
     *last_object_volume = getObjectVolumePtrById(object_id);
 
@@ -75,9 +98,15 @@ TsdfVoxel *Map::allocateStorageAndGetVoxelPtr(
     }
 
     *last_object_id = object_id;
+    *last_tsdf_block = nullptr;
+  }
 
-    *last_tsdf_block =
-        (*last_object_volume)->getTsdfLayerPtr()->getBlockPtrByIndex(block_idx);
+  const GlobalIndex object_voxel_idx =
+      (*last_object_volume)->getObjectVoxelIndex(global_voxel_idx);
+  const BlockIndex block_idx = voxel_indexer_.getBlockIndex(object_voxel_idx);
+
+  if ((block_idx != *last_tsdf_block_idx) || (*last_tsdf_block == nullptr)) {
+    *last_tsdf_block = (*last_object_volume)->getTsdfBlockPtrByIndex(block_idx);
 
     // If no block at this location currently exists, we allocate it.
     if (*last_tsdf_block == nullptr) {
@@ -86,33 +115,56 @@ TsdfVoxel *Map::allocateStorageAndGetVoxelPtr(
     }
 
     *last_tsdf_block_idx = block_idx;
-  } else {
-    if ((block_idx != *last_tsdf_block_idx) || (*last_tsdf_block == nullptr)) {
-      *last_tsdf_block = (*last_object_volume)
-                             ->getTsdfLayerPtr()
-                             ->getBlockPtrByIndex(block_idx);
-
-      // If no block at this location currently exists, we allocate it.
-      if (*last_tsdf_block == nullptr) {
-        *last_tsdf_block =
-            (*last_object_volume)->allocateStorageAndGetBlockPtr(block_idx);
-      }
+  }
+
+  return &((*last_tsdf_block)->getVoxelByLinearIndex(
+      voxel_indexer_.getLinearIndex(object_voxel_idx)));
+}
 
-      *last_tsdf_block_idx = block_idx;
+TsdfVoxel *Map::getAllocatedTsdfVoxelPtr(
+    const ObjectID &object_id, const GlobalIndex &global_voxel_idx,
+    ObjectVolume **last_object_volume, ObjectID *last_object_id,
+    Block<TsdfVoxel> **last_tsdf_block, BlockIndex *last_tsdf_block_idx) {
+  CHECK_NOTNULL(last_object_volume);
+  CHECK_NOTNULL(last_object_id);
+  CHECK_NOTNULL(last_tsdf_block);
+  CHECK_NOTNULL(last_tsdf_block_idx);
+
+  bool is_block_cached = true;
+  if ((object_id != *last_object_id) || (*last_object_volume == nullptr)) {
+    *last_object_volume = getObjectVolumePtrById(object_id);
+    *last_object_id = object_id;
+
+    if (*last_object_volume == nullptr) {
+      *last_tsdf_block = nullptr;
+      return nullptr;
     }
+
+    is_block_cached = false;
   }
 
-  // Get the corresponding voxel by 3D position in world frame.
-  const VoxelIndex local_voxel_idx =
-      getLocalFromGlobalVoxelIndex(global_voxel_idx, config_.voxels_per_side);
+  const GlobalIndex object_voxel_idx =
+      (*last_object_volume)->getObjectVoxelIndex(global_voxel_idx);
+  const BlockIndex block_idx = voxel_indexer_.getBlockIndex(object_voxel_idx);
 
-  return &((*last_tsdf_block)->getVoxelByVoxelIndex(local_voxel_idx));
+  if (!is_block_cached || block_idx != *last_tsdf_block_idx) {
+    *last_tsdf_block =
+        (*last_object_volume)->getTsdfBlockPtrByIndex(block_idx);
+    *last_tsdf_block_idx = block_idx;
+  }
+
+  if (*last_tsdf_block == nullptr) {
+    return nullptr;
+  }
+
+  return &((*last_tsdf_block)->getVoxelByLinearIndex(
+      voxel_indexer_.getLinearIndex(object_voxel_idx)));
 }
 
 TsdfVoxel *Map::getTsdfVoxelPtrByVoxelIndex(
     const ObjectID &object_id, const BlockIndex &block_idx,
     const VoxelIndex &voxel_index, ObjectVolume **last_object_volume,
-    ObjectID *last_object_id, Block<TsdfVoxel>::Ptr *last_tsdf_block,
+    ObjectID *last_object_id, Block<TsdfVoxel> **last_tsdf_block,
     BlockIndex *last_tsdf_block_idx) {
   CHECK_NOTNULL(last_object_volume);
   CHECK_NOTNULL(last_object_id);
@@ -134,77 +186,84 @@ TsdfVoxel *Map::getTsdfVoxelPtrByVoxelIndex(
 
     *last_object_volume = object_volume_it->second;
     *last_object_id = object_id;
+    *last_tsdf_block = nullptr;
+  }
 
+  // Map voxels of coarser objects are looked up by global index, the object
+  // blocks do not line up with the map blocks.
+  const bool is_coarser = (*last_object_volume)->getVoxelScaleShift() > 0u;
+  const GlobalIndex object_voxel_idx =
+      is_coarser ? (*last_object_volume)->getObjectVoxelIndex(
+                       voxel_indexer_.getGlobalVoxelIndex(block_idx,
+                                                          voxel_index))
+                 : GlobalIndex();
+  const BlockIndex object_block_idx =
+      is_coarser ? voxel_indexer_.getBlockIndex(object_voxel_idx) : block_idx;
+
+  if ((object_block_idx != *last_tsdf_block_idx) ||
+      (*last_tsdf_block == nullptr)) {
     *last_tsdf_block =
-        (*last_object_volume)->getTsdfLayerPtr()->getBlockPtrByIndex(block_idx);
-    *last_tsdf_block_idx = block_idx;
-  } else {
-    if ((block_idx != *last_tsdf_block_idx) || (*last_tsdf_block == nullptr)) {
-      *last_tsdf_block = (*last_object_volume)
-                             ->getTsdfLayerPtr()
-                             ->getBlockPtrByIndex(block_idx);
-
-      if (*last_tsdf_block == nullptr) {
-        LOG(ERROR) << "Trying to acces a non-existent block of object "
-                   << static_cast<unsigned>(object_id)
-                   << " at index: " << block_idx.transpose();
-        return nullptr;
-      }
+        (*last_object_volume)->getTsdfBlockPtrByIndex(object_block_idx);
 
-      *last_tsdf_block_idx = block_idx;
+    if (*last_tsdf_block == nullptr) {
+      LOG(ERROR) << "Trying to acces a non-existent block of object "
+                 << static_cast<unsigned>(object_id)
+                 << " at index: " << object_block_idx.transpose();
+      return nullptr;
     }
+
+    *last_tsdf_block_idx = object_block_idx;
   }
 
+  if (is_coarser) {
+    return &((*last_tsdf_block)->getVoxelByLinearIndex(
+        voxel_indexer_.getLinearIndex(object_voxel_idx)));
+  }
   return &((*last_tsdf_block)->getVoxelByVoxelIndex(voxel_index));
 }
 
 TsdfVoxel *Map::getTsdfVoxelPtrByLinearIndex(
     const ObjectID &object_id, const BlockIndex &block_idx,
     const IndexElement &voxel_index, ObjectVolume **last_object_volume,
-    ObjectID *last_object_id, Block<TsdfVoxel>::Ptr *last_tsdf_block,
+    ObjectID *last_object_id, Block<TsdfVoxel> **last_tsdf_block,
     BlockIndex *last_tsdf_block_idx) {
-  CHECK_NOTNULL(last_object_volume);
-  CHECK_NOTNULL(last_object_id);
-  CHECK_NOTNULL(last_tsdf_block);
-  CHECK_NOTNULL(last_tsdf_block_idx);
+  return getTsdfVoxelPtrByVoxelIndex(
+      object_id, block_idx,
+      voxel_indexer_.getVoxelIndexFromLinearIndex(
+          static_cast<size_t>(voxel_index)),
+      last_object_volume, last_object_id, last_tsdf_block,
+      last_tsdf_block_idx);
+}
 
-  if ((object_id != *last_object_id) || (*last_object_volume == nullptr)) {
-    auto object_volume_it = object_volumes_->find(object_id);
+void Map::getCoveredMapBlocks(ObjectVolume *object_volume,
+                              BlockIndexList *map_block_indices) const {
+  CHECK_NOTNULL(object_volume);
+  CHECK_NOTNULL(map_block_indices);
 
-    if (object_volume_it == object_volumes_->end()) {
-      // This should not happen, however one other thing that could be
-      // done for extra safety is a reader lock, or directly calling
-      // getObjectVolumePtrById().
-      LOG(ERROR) << "Trying to access index: " << block_idx.transpose()
-                 << " of a non-existent object volume "
-                 << static_cast<unsigned>(object_id);
-      return nullptr;
-    }
+  BlockIndexList object_blocks;
+  object_volume->getTsdfLayerPtr()->getAllAllocatedBlocks(&object_blocks);
 
-    *last_object_volume = object_volume_it->second;
-    *last_object_id = object_id;
+  const unsigned int shift = object_volume->getVoxelScaleShift();
+  if (shift == 0u) {
+    map_block_indices->swap(object_blocks);
+    return;
+  }
 
-    *last_tsdf_block =
-        (*last_object_volume)->getTsdfLayerPtr()->getBlockPtrByIndex(block_idx);
-    *last_tsdf_block_idx = block_idx;
-  } else {
-    if ((block_idx != *last_tsdf_block_idx) || (*last_tsdf_block == nullptr)) {
-      *last_tsdf_block = (*last_object_volume)
-                             ->getTsdfLayerPtr()
-                             ->getBlockPtrByIndex(block_idx);
-
-      if (*last_tsdf_block == nullptr) {
-        LOG(ERROR) << "Trying to acces a non-existent block of object "
-                   << static_cast<unsigned>(object_id)
-                   << " at index: " << block_idx.transpose();
-        return nullptr;
+  // Each object block spans 2^shift map blocks along each axis.
+  const IndexElement scale = static_cast<IndexElement>(1u << shift);
+  map_block_indices->clear();
+  map_block_indices->reserve(object_blocks.size() * scale * scale * scale);
+  for (const BlockIndex &object_block_idx : object_blocks) {
+    const BlockIndex first_block_idx = object_block_idx * scale;
+    BlockIndex offset;
+    for (offset.x() = 0; offset.x() < scale; ++offset.x()) {
+      for (offset.y() = 0; offset.y() < scale; ++offset.y()) {
+        for (offset.z() = 0; offset.z() < scale; ++offset.z()) {
+          map_block_indices->push_back(first_block_idx + offset);
+        }
       }
-
-      *last_tsdf_block_idx = block_idx;
     }
   }
-
-  return &((*last_tsdf_block)->getVoxelByLinearIndex(voxel_index));
 }
 
 void Map::transformLayer(const ObjectID &object_id,
@@ -214,29 +273,29 @@ void Map::transformLayer(const ObjectID &object_id,
 
   // First, deactivate all voxels in the map layer
   // corresponding to the object_volume.
-  BlockIndexList all_object_blocks;
-  object_layer->getAllAllocatedBlocks(&all_object_blocks);
+  BlockIndexList map_blocks;
+  getCoveredMapBlocks(object_volume, &map_blocks);
 
-  for (const BlockIndex &block_index : all_object_blocks) {
-    Block<MOVoxel>::Ptr mo_block = map_layer_->getBlockPtrByIndex(block_index);
+  for (const BlockIndex &block_index : map_blocks) {
+    Block<MOVoxel> *mo_block = map_blocks_.find(block_index);
+    if (mo_block == nullptr) {
+      continue;
+    }
 
     for (IndexElement voxel_idx = 0;
          voxel_idx < static_cast<IndexElement>(mo_block->num_voxels());
          ++voxel_idx) {
       MOVoxel &mo_voxel = mo_block->getVoxelByLinearIndex(voxel_idx);
-
-      if (mo_voxel.active_object.object_id == object_id) {
-        mo_voxel.active_object = mo_voxel.inactive_object;
-        mo_voxel.inactive_object = Object();
-      } else if (mo_voxel.inactive_object.object_id == object_id) {
-        mo_voxel.inactive_object = Object();
-      }
+      mo_voxel.removeObject(object_id);
     }
 
     mo_block->updated().set();
   }
 
   // Next, transform the object_volume.
+  BlockIndexList all_object_blocks;
+  object_layer->getAllAllocatedBlocks(&all_object_blocks);
+
   Layer<TsdfVoxel> *layer_out = new Layer<TsdfVoxel>(
       object_layer->voxel_size(), object_layer->voxels_per_side());
 
@@ -277,94 +336,156 @@ void Map::transformLayer(const ObjectID &object_id,
 
   Interpolator<TsdfVoxel> interpolator(object_layer);
 
-  ObjectID last_object_id;
-  ObjectVolume *last_object_volume = nullptr;
-  Block<TsdfVoxel>::Ptr last_tsdf_block = nullptr;
-  BlockIndex last_tsdf_block_idx;
+  // Each object voxel covers a cube of scale^3 map voxels.
+  const IndexElement scale =
+      static_cast<IndexElement>(1u << object_volume->getVoxelScaleShift());
 
   // We now go through all the blocks in the output layer and interpolate the
   // input layer at the center of each output voxel position. For each
   // interpolated voxel, activate the object_id in the corresponding map layer
-  // voxel.
+  // voxels.
   for (const BlockIndex &block_idx : block_idx_set) {
     typename Block<TsdfVoxel>::Ptr block =
         layer_out->allocateBlockPtrByIndex(block_idx);
 
-    // Fetch corresponding block in the map layer.
-    typename Block<MOVoxel>::Ptr mo_block =
-        getMapLayerPtr()->allocateBlockPtrByIndex(block_idx);
+    Block<MOVoxel> *mo_block = nullptr;
+    BlockIndex mo_block_idx;
 
     for (IndexElement voxel_idx = 0;
          voxel_idx < static_cast<IndexElement>(block->num_voxels());
          ++voxel_idx) {
       TsdfVoxel &voxel = block->getVoxelByLinearIndex(voxel_idx);
-      // Map voxel in which to activate the object being moved.
-      MOVoxel &mo_voxel = mo_block->getVoxelByLinearIndex(voxel_idx);
 
       // Find voxel centers location in the input.
       const Point voxel_center =
           T_in_out * block->computeCoordinatesFromLinearIndex(voxel_idx);
 
       // Interpolate voxel.
-      if (interpolator.getVoxel(voxel_center, &voxel, false)) {
-        block->has_data() = true;
-
-        // Deactivate previous object, activate the interpolated one.
-        mo_voxel.inactive_object = mo_voxel.active_object;
-        mo_voxel.active_object.object_id = object_id;
-        // TODO(margaritaG): parametrize this.
-        mo_voxel.active_object.confidence = 4u;
+      if (!interpolator.getVoxel(voxel_center, &voxel, false)) {
+        continue;
+      }
+      block->has_data() = true;
+
+      const GlobalIndex first_global_voxel_idx =
+          voxel_indexer_.getGlobalVoxelIndex(
+              block_idx, block->computeVoxelIndexFromLinearIndex(voxel_idx)) *
+          scale;
+
+      GlobalIndex offset;
+      for (offset.x() = 0; offset.x() < scale; ++offset.x()) {
+        for (offset.y() = 0; offset.y() < scale; ++offset.y()) {
+          for (offset.z() = 0; offset.z() < scale; ++offset.z()) {
+            const GlobalIndex global_voxel_idx =
+                first_global_voxel_idx + offset;
+
+            // Fetch corresponding block in the map layer.
+            const BlockIndex global_block_idx =
+                voxel_indexer_.getBlockIndex(global_voxel_idx);
+            if (mo_block == nullptr || global_block_idx != mo_block_idx) {
+              mo_block = allocateMapBlockPtrByIndex(global_block_idx);
+              mo_block_idx = global_block_idx;
+              mo_block->updated().set();
+            }
+
+            // Map voxel in which to activate the object being moved.
+            MOVoxel &mo_voxel = mo_block->getVoxelByLinearIndex(
+                voxel_indexer_.getLinearIndex(global_voxel_idx));
+
+            // Deactivate previous object, activate the interpolated one.
+            // TODO(margaritaG): parametrize this.
+            mo_voxel.activateObject(object_id, 4u);
+          }
+        }
       }
     }
 
     if (!block->has_data()) {
       layer_out->removeBlock(block_idx);
-    } else {
-      mo_block->updated().set();
     }
   }
 
-  // TODO(margaritaG): potential memory leak,
-  // delete the previous tsdf_layer?
-  *object_layer = *layer_out;
+  // Frees the previous layer, object_layer is invalid from here on.
+  object_volume->resetTsdfLayer(layer_out);
 }
 
-void Map::removeObject(const ObjectID &object_id) {
+ObjectID Map::getFreshObjectId() {
+  if (!free_object_ids_.empty()) {
+    const ObjectID object_id = free_object_ids_.front();
+    free_object_ids_.pop_front();
+    return object_id;
+  }
+
+  CHECK_LT(*highest_object_id_, std::numeric_limits<ObjectID>::max())
+      << "All object ids are in use.";
+  return ++(*highest_object_id_);
+}
+
+size_t Map::removeObject(const ObjectID &object_id,
+                         BlockIndexList *pruned_block_indices) {
   ObjectVolume *object_volume = getObjectVolumePtrById(object_id);
-  Layer<TsdfVoxel> *object_layer = object_volume->getTsdfLayerPtr();
+  if (object_volume == nullptr) {
+    LOG(WARNING) << "Trying to remove a non-existent object volume "
+                 << static_cast<unsigned>(object_id);
+    return 0u;
+  }
+  size_t freed_bytes = object_volume->getTsdfLayerPtr()->getMemorySize();
 
   // Deactivate all voxels in the map layer
   // corresponding to the object_volume.
-  BlockIndexList all_object_blocks;
-  object_layer->getAllAllocatedBlocks(&all_object_blocks);
+  BlockIndexList map_blocks;
+  getCoveredMapBlocks(object_volume, &map_blocks);
 
-  for (const BlockIndex &block_index : all_object_blocks) {
-    Block<MOVoxel>::Ptr mo_block = map_layer_->getBlockPtrByIndex(block_index);
+  for (const BlockIndex &block_index : map_blocks) {
+    Block<MOVoxel> *mo_block = map_blocks_.find(block_index);
+    if (mo_block == nullptr) {
+      continue;
+    }
 
+    bool is_block_empty = true;
     for (IndexElement voxel_idx = 0;
          voxel_idx < static_cast<IndexElement>(mo_block->num_voxels());
          ++voxel_idx) {
       MOVoxel &mo_voxel = mo_block->getVoxelByLinearIndex(voxel_idx);
+      mo_voxel.removeObject(object_id);
+      is_block_empty = is_block_empty && mo_voxel.isEmpty();
+    }
+
+    if (is_block_empty) {
+      // Nothing is left in the block, e.g. it was only allocated for the
+      // removed object, hence deallocate it.
+      freed_bytes += mo_block->getMemorySize();
+      map_blocks_.erase(block_index);
+      map_layer_->removeBlock(block_index);
 
-      if (mo_voxel.active_object.object_id == object_id) {
-        mo_voxel.active_object = mo_voxel.inactive_object;
-        mo_voxel.inactive_object = Object();
-      } else if (mo_voxel.inactive_object.object_id == object_id) {
-        mo_voxel.inactive_object = Object();
+      if (pruned_block_indices != nullptr) {
+        pruned_block_indices->push_back(block_index);
       }
+    } else {
+      mo_block->updated().set();
     }
+  }
 
-    mo_block->updated().set();
+  {
+    std::lock_guard<std::shared_timed_mutex> object_volumes_writer_lock(
+        object_volumes_mutex_);
+    object_volumes_->erase(object_id);
   }
+  delete object_volume;
+
+  free_object_ids_.push_back(object_id);
+
+  return freed_bytes;
 }
 
 void Map::clear() {
   // Reset Map Layer
   map_layer_.reset(
       new Layer<MOVoxel>(config_.voxel_size, config_.voxels_per_side));
+  map_blocks_.clear();
 
   // Reset Highest Object ID
   *highest_object_id_ = ObjectID();
+  free_object_ids_.clear();
 
   // Reset Object Volumes
   for (auto &pair : *object_volumes_) {
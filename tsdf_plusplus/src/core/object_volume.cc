@@ -3,13 +3,22 @@
 
 #include "tsdf_plusplus/core/object_volume.h"
 
+#include <cmath>
+
 using namespace voxblox;
 
-ObjectVolume::ObjectVolume(float voxel_size, size_t voxels_per_side,
+ObjectVolume::ObjectVolume(float map_voxel_size, size_t voxels_per_side,
+                           unsigned int voxel_scale_shift,
                            const Point centroid,
                            const SemanticClass& semantic_class)
-    : tsdf_layer_(new Layer<TsdfVoxel>(voxel_size, voxels_per_side)),
-      semantic_class_(semantic_class) {
+    : tsdf_layer_(new Layer<TsdfVoxel>(
+          map_voxel_size * static_cast<float>(1u << voxel_scale_shift),
+          voxels_per_side)),
+      voxel_scale_shift_(voxel_scale_shift),
+      voxel_indexer_(voxels_per_side),
+      semantic_class_(semantic_class),
+      num_observations_(0u),
+      last_observation_time_(std::chrono::steady_clock::now()) {
   pose_ = Transformation(Rotation(), centroid);
 }
 
@@ -20,14 +29,82 @@ void ObjectVolume::accumulateTransform(Transformation transform) {
   pose_ = Transformation(pose_.getRotation().normalize(), pose_.getPosition());
 }
 
-Block<TsdfVoxel>::Ptr ObjectVolume::allocateStorageAndGetBlockPtr(
+void ObjectVolume::resetTsdfLayer(Layer<TsdfVoxel>* tsdf_layer) {
+  CHECK_NOTNULL(tsdf_layer);
+  tsdf_layer_.reset(tsdf_layer);
+
+  tsdf_blocks_.clear();
+  BlockIndexList all_blocks;
+  tsdf_layer_->getAllAllocatedBlocks(&all_blocks);
+  for (const BlockIndex& block_idx : all_blocks) {
+    tsdf_blocks_.insert(block_idx,
+                        tsdf_layer_->getBlockPtrByIndex(block_idx).get());
+  }
+}
+
+bool ObjectVolume::getInterpolatedDistance(const Point& point,
+                                           float min_weight,
+                                           FloatingPoint* distance) const {
+  CHECK_NOTNULL(distance);
+
+  // Position in units of voxels relative to the voxel centers.
+  const Point point_scaled =
+      point / tsdf_layer_->voxel_size() - Point::Constant(0.5);
+  const GlobalIndex base_idx(
+      static_cast<LongIndexElement>(std::floor(point_scaled.x())),
+      static_cast<LongIndexElement>(std::floor(point_scaled.y())),
+      static_cast<LongIndexElement>(std::floor(point_scaled.z())));
+  const Point offset = point_scaled - base_idx.cast<FloatingPoint>();
+
+  FloatingPoint interpolated_distance = 0.0f;
+  for (unsigned int i = 0u; i < 8u; ++i) {
+    const GlobalIndex corner_offset(i & 1u, (i >> 1u) & 1u, (i >> 2u) & 1u);
+    const TsdfVoxel* voxel =
+        getTsdfVoxelPtrByGlobalIndex(base_idx + corner_offset);
+    if (voxel == nullptr || voxel->weight < min_weight) {
+      return false;
+    }
+
+    FloatingPoint corner_weight = 1.0f;
+    for (unsigned int j = 0u; j < 3u; ++j) {
+      corner_weight *= corner_offset(j) ? offset(j) : 1.0f - offset(j);
+    }
+    interpolated_distance += corner_weight * voxel->distance;
+  }
+
+  *distance = interpolated_distance;
+  return true;
+}
+
+void ObjectVolume::recordObservation() {
+  ++num_observations_;
+  last_observation_time_ = std::chrono::steady_clock::now();
+}
+
+size_t ObjectVolume::countObservedVoxels(float min_weight) const {
+  BlockIndexList all_blocks;
+  tsdf_layer_->getAllAllocatedBlocks(&all_blocks);
+
+  size_t num_observed_voxels = 0u;
+  for (const BlockIndex& block_idx : all_blocks) {
+    const Block<TsdfVoxel>* block = tsdf_blocks_.find(block_idx);
+    for (size_t voxel_idx = 0u; voxel_idx < block->num_voxels(); ++voxel_idx) {
+      if (block->getVoxelByLinearIndex(voxel_idx).weight >= min_weight) {
+        ++num_observed_voxels;
+      }
+    }
+  }
+  return num_observed_voxels;
+}
+
+Block<TsdfVoxel>* ObjectVolume::allocateStorageAndGetBlockPtr(
     const BlockIndex& block_idx) {
   std::lock_guard<std::mutex> lock(temp_block_mutex_);
 
   typename Layer<TsdfVoxel>::BlockHashMap::iterator it =
       temp_block_map_.find(block_idx);
   if (it != temp_block_map_.end()) {
-    return it->second;
+    return it->second.get();
   } else {
     auto insert_status = temp_block_map_.emplace(
         block_idx,
@@ -38,18 +115,16 @@ Block<TsdfVoxel>::Ptr ObjectVolume::allocateStorageAndGetBlockPtr(
     CHECK(insert_status.second)
         << "Block already exists when allocating at " << block_idx.transpose();
 
-    return insert_status.first->second;
+    return insert_status.first->second.get();
   }
 }
 
 // NOT thread safe.
 void ObjectVolume::updateLayerWithStoredBlocks() {
-  BlockIndex last_block_idx;
-  Block<TsdfVoxel>::Ptr block = nullptr;
-
   for (const std::pair<const BlockIndex, Block<TsdfVoxel>::Ptr>&
            temp_block_pair : temp_block_map_) {
     tsdf_layer_->insertBlock(temp_block_pair);
+    tsdf_blocks_.insert(temp_block_pair.first, temp_block_pair.second.get());
   }
 
   temp_block_map_.clear();
@@ -3,32 +3,77 @@
 
 #include "tsdf_plusplus/core/segment.h"
 
+#include <cstring>
+
+#include <glog/logging.h>
 #include <pcl/common/centroid.h>
 #include <pcl/common/io.h>
 
 Segment::Segment(const pcl::PointCloud<InputPointType> &pointcloud_pcl,
-                 const voxblox::Transformation &T_G_C)
-    : T_G_C_(T_G_C), semantic_class_(pointcloud_pcl.points[0].semantic_class)
+                 const voxblox::Transformation &T_G_C, bool with_colors)
 {
-  pointcloud_ = pointcloud_pcl;
-  convertPointcloud();
+  assign(pointcloud_pcl, T_G_C, with_colors);
 }
 
 Segment::Segment(const pcl::PointCloud<GTInputPointType> &pointcloud_pcl,
-                 const voxblox::Transformation &T_G_C, const ObjectID object_id)
-    : T_G_C_(T_G_C), object_id_(object_id), semantic_class_(BackgroundClass)
+                 const voxblox::Transformation &T_G_C, const ObjectID object_id,
+                 bool with_colors)
+{
+  assign(pointcloud_pcl, T_G_C, object_id, with_colors);
+}
+
+Segment::Segment(const voxblox::Transformation &T_G_C, const ObjectID object_id,
+                 const SemanticClass semantic_class)
+{
+  assign(T_G_C, object_id, semantic_class);
+}
+
+void Segment::assign(const pcl::PointCloud<InputPointType> &pointcloud_pcl,
+                     const voxblox::Transformation &T_G_C, bool with_colors)
+{
+  T_G_C_ = T_G_C;
+  semantic_class_ = pointcloud_pcl.points[0].semantic_class;
+
+  pointcloud_ = pointcloud_pcl;
+  convertPointcloud(with_colors);
+}
+
+void Segment::assign(const pcl::PointCloud<GTInputPointType> &pointcloud_pcl,
+                     const voxblox::Transformation &T_G_C,
+                     const ObjectID object_id, bool with_colors)
 {
+  T_G_C_ = T_G_C;
+  object_id_ = object_id;
+  semantic_class_ = BackgroundClass;
+
   pcl::copyPointCloud(pointcloud_pcl, pointcloud_);
-  convertPointcloud();
+  convertPointcloud(with_colors);
+}
+
+void Segment::assign(const voxblox::Transformation &T_G_C,
+                     const ObjectID object_id,
+                     const SemanticClass semantic_class)
+{
+  T_G_C_ = T_G_C;
+  centroid_ = voxblox::Point::Zero();
+  object_id_ = object_id;
+  semantic_class_ = semantic_class;
+
+  points_C_.clear();
+  colors_.clear();
+  pointcloud_.clear();
 }
 
-void Segment::convertPointcloud()
+void Segment::convertPointcloud(bool with_colors)
 {
   points_C_.clear();
   colors_.clear();
 
   points_C_.reserve(pointcloud_.points.size());
-  colors_.reserve(pointcloud_.points.size());
+  if (with_colors)
+  {
+    colors_.reserve(pointcloud_.points.size());
+  }
 
   for (size_t i = 0u; i < pointcloud_.points.size(); ++i)
   {
@@ -43,9 +88,12 @@ void Segment::convertPointcloud()
                                        pointcloud_.points[i].y,
                                        pointcloud_.points[i].z));
 
-    colors_.push_back(
-        voxblox::Color(pointcloud_.points[i].r, pointcloud_.points[i].g,
-                       pointcloud_.points[i].b, pointcloud_.points[i].a));
+    if (with_colors)
+    {
+      colors_.push_back(
+          voxblox::Color(pointcloud_.points[i].r, pointcloud_.points[i].g,
+                         pointcloud_.points[i].b, pointcloud_.points[i].a));
+    }
   }
 
   Eigen::Vector4f centroid_c;
@@ -54,3 +102,154 @@ void Segment::convertPointcloud()
   centroid_ =
       T_G_C_ * voxblox::Point(centroid_c.x(), centroid_c.y(), centroid_c.z());
 }
+
+void Segment::computeCentroid()
+{
+  voxblox::Point centroid_c = voxblox::Point::Zero();
+  for (const voxblox::Point &point_C : points_C_)
+  {
+    centroid_c += point_C;
+  }
+
+  if (!points_C_.empty())
+  {
+    centroid_c /= static_cast<voxblox::FloatingPoint>(points_C_.size());
+  }
+
+  centroid_ = T_G_C_ * centroid_c;
+}
+
+void Segment::merge(const Segment &segment)
+{
+  const size_t num_points = points_C_.size() + segment.points_C_.size();
+  if (num_points == 0u)
+  {
+    return;
+  }
+
+  // Both centroids are in global frame, weight them by their number of points.
+  centroid_ = (centroid_ * points_C_.size() +
+               segment.centroid_ * segment.points_C_.size()) /
+              static_cast<voxblox::FloatingPoint>(num_points);
+
+  points_C_.insert(points_C_.end(), segment.points_C_.begin(),
+                   segment.points_C_.end());
+  colors_.insert(colors_.end(), segment.colors_.begin(),
+                 segment.colors_.end());
+  pointcloud_ += segment.pointcloud_;
+}
+
+void SegmentPool::clear()
+{
+  segments_.clear();
+  num_acquired_ = 0u;
+}
+
+void unprojectSegments(
+    const SegmentImages &images,
+    const std::unordered_map<uint16_t, Segment *> &label_segments)
+{
+  CHECK_NOTNULL(images.depth);
+  CHECK_NOTNULL(images.labels);
+  CHECK_GE(images.depth_step,
+           images.width * (images.depth_in_mm ? sizeof(uint16_t)
+                                              : sizeof(float)));
+  CHECK_GE(images.labels_step, images.width * sizeof(uint16_t));
+  if (images.color != nullptr)
+  {
+    CHECK_GE(images.color_step, images.width * images.color_channels);
+    CHECK_GE(images.color_channels, 3u);
+  }
+
+  // Precompute the ray direction factors of each column and row, such that a
+  // pixel (u, v) of depth d unprojects to (x[u] * d, y[v] * d, d).
+  std::vector<float> x_factors(images.width);
+  for (size_t u = 0u; u < images.width; ++u)
+  {
+    x_factors[u] = (u - images.cx) / images.fx;
+  }
+  std::vector<float> y_factors(images.height);
+  for (size_t v = 0u; v < images.height; ++v)
+  {
+    y_factors[v] = (v - images.cy) / images.fy;
+  }
+
+  const size_t red_offset = images.bgr_order ? 2u : 0u;
+  const size_t blue_offset = images.bgr_order ? 0u : 2u;
+  const float depth_scale = images.depth_in_mm ? 1e-3f : 1.0f;
+
+  // Labels come in runs of neighboring pixels, so the
+  // segment of the previous pixel is looked up first.
+  uint16_t last_label = 0u;
+  Segment *last_segment = nullptr;
+
+  std::vector<float> depth_row(images.width);
+
+  for (size_t v = 0u; v < images.height; ++v)
+  {
+    // Convert the depth row to meters in a separate, vectorizable loop.
+    const uint8_t *depth_data = images.depth + v * images.depth_step;
+    if (images.depth_in_mm)
+    {
+      const uint16_t *depth_mm = reinterpret_cast<const uint16_t *>(depth_data);
+      for (size_t u = 0u; u < images.width; ++u)
+      {
+        depth_row[u] = depth_scale * depth_mm[u];
+      }
+    }
+    else
+    {
+      std::memcpy(depth_row.data(), depth_data, images.width * sizeof(float));
+    }
+
+    const uint16_t *label_row = reinterpret_cast<const uint16_t *>(
+        images.labels + v * images.labels_step);
+    const uint8_t *color_row =
+        (images.color != nullptr) ? images.color + v * images.color_step
+                                  : nullptr;
+    const float y_factor = y_factors[v];
+
+    for (size_t u = 0u; u < images.width; ++u)
+    {
+      const uint16_t label = label_row[u];
+      const float depth = depth_row[u];
+
+      // NaN depths fail the comparison as well.
+      if (label == 0u || !(depth > 0.0f) || std::isinf(depth))
+      {
+        continue;
+      }
+
+      if (label != last_label || last_segment == nullptr)
+      {
+        auto segment_it = label_segments.find(label);
+        last_segment =
+            (segment_it != label_segments.end()) ? segment_it->second : nullptr;
+        last_label = label;
+      }
+
+      if (last_segment == nullptr)
+      {
+        continue;
+      }
+
+      last_segment->points_C_.emplace_back(x_factors[u] * depth,
+                                           y_factor * depth, depth);
+
+      if (color_row != nullptr)
+      {
+        const uint8_t *color = color_row + u * images.color_channels;
+        last_segment->colors_.emplace_back(color[red_offset], color[1],
+                                           color[blue_offset]);
+      }
+    }
+  }
+
+  for (const auto &pair : label_segments)
+  {
+    if (pair.second != nullptr)
+    {
+      pair.second->computeCentroid();
+    }
+  }
+}
@@ -3,35 +3,99 @@
 
 #include "tsdf_plusplus/integrator/integrator.h"
 
+#include <algorithm>
+#include <limits>
+
 #include <pcl/common/centroid.h>
 #include <voxblox/core/voxel.h>
 
+// Timer tags are constructed once, a tag built from a string literal for
+// each segment would allocate.
+static const std::string kConcurrentSegmentsTimerTag =
+    "integrate/concurrent_segments";
+static const std::string kInsertBlocksTimerTag = "integrate/insert_blocks";
+static const std::string kSegmentTimerTag = "integrate/segment";
+static const std::string kBundleRaysTimerTag = "integrate/1_bundle_rays";
+static const std::string kIntegrateRaysTimerTag = "integrate/2_integrate_rays";
+static const std::string kClearTimerTag = "integrate/3_clear";
+
 Integrator::Integrator(const Config &config, std::shared_ptr<Map> map)
-    : config_(config), map_(map.get()),
-      highest_object_id_(map->getHighestObjectIdPtr()) {
+    : config_(config),
+      sensor_model_(getSensorModelConfig(
+          config, map->getMapLayerPtr()->voxel_size())),
+      map_(map.get()),
+      voxel_indexer_(map->getMapLayerPtr()->voxels_per_side()) {
   voxel_size_ = map_->getMapLayerPtr()->voxel_size();
   block_size_ = map_->getMapLayerPtr()->block_size();
   voxels_per_side_ = map_->getMapLayerPtr()->voxels_per_side();
 
   voxel_size_inv_ = 1.0 / voxel_size_;
   block_size_inv_ = 1.0 / block_size_;
-  voxels_per_side_inv_ = 1.0 / voxels_per_side_;
 
   if (config_.integrator_threads == 0) {
     LOG(WARNING) << "Automatic core count failed, defaulting to 1 thread.";
     config_.integrator_threads = 1;
   }
+
+  worker_pool_.reset(new WorkerPool(config_.integrator_threads));
+  thread_buffers_.reserve(config_.integrator_threads);
+  for (size_t i = 0u; i < config_.integrator_threads; ++i) {
+    thread_buffers_.emplace_back(new ThreadBuffers(voxels_per_side_));
+  }
   // Clearing rays have no utility if voxel_carving is disabled.
   if (config_.allow_clear && !config_.voxel_carving_enabled) {
     config_.allow_clear = false;
   }
+
+  kernel_flags_ = 0u;
+  if (config_.enable_anti_grazing) {
+    kernel_flags_ |= kAntiGrazing;
+  }
+  if (!config_.integrate_color) {
+    kernel_flags_ |= kNoColor;
+  }
+
+  mutex_index_shift_ = map_->getMaxVoxelScaleShift();
+  if (config_.truncation_distance <
+      voxel_size_ * static_cast<float>(1u << mutex_index_shift_)) {
+    LOG(WARNING) << "The coarsest object voxels are larger than the "
+                    "truncation distance, their surfaces may have holes.";
+  }
+}
+
+SensorModel::Config
+Integrator::getSensorModelConfig(const Config &config, float voxel_size) {
+  SensorModel::Config sensor_model_config;
+
+  if (config.use_const_weight) {
+    sensor_model_config.depth_model = SensorModel::DepthModel::kConstant;
+  } else if (!SensorModel::getDepthModelFromString(
+                 config.sensor_model, &sensor_model_config.depth_model)) {
+    LOG(WARNING) << "Unknown sensor model " << config.sensor_model
+                 << ", defaulting to inverse_square.";
+  }
+  sensor_model_config.min_depth = config.min_ray_length_m;
+  sensor_model_config.max_depth = config.max_ray_length_m;
+
+  // The weight drops off from one voxel behind the surface. Object voxels
+  // and truncation distance scale together, so relative to the truncation
+  // distance the drop-off starts at the same place in all object volumes.
+  sensor_model_config.dropoff_epsilon = voxel_size / config.truncation_distance;
+  sensor_model_config.use_weight_dropoff =
+      config.use_weight_dropoff && sensor_model_config.dropoff_epsilon < 1.0f;
+
+  sensor_model_config.use_sparsity_compensation =
+      config.use_sparsity_compensation_factor;
+  sensor_model_config.sparsity_compensation_factor =
+      config.sparsity_compensation_factor;
+
+  return sensor_model_config;
 }
 
-void Integrator::computeObjectOverlap(
-    Segment *segment,
-    std::map<ObjectID, SegmentHistogram> *object_segment_overlap) {
+void Integrator::computeObjectOverlap(Segment *segment,
+                                      SegmentOverlapList *segment_overlaps) {
   CHECK_NOTNULL(segment);
-  CHECK_NOTNULL(object_segment_overlap);
+  CHECK_NOTNULL(segment_overlaps);
 
   bool exists_overlapping_object = false;
 
@@ -39,20 +103,20 @@ void Integrator::computeObjectOverlap(
     const Point point_G = segment->T_G_C_ * point_C;
 
     // Get the corresponding voxel by 3D position in world frame.
-    Layer<MOVoxel>::BlockType::ConstPtr mo_block_ptr =
-        map_->getMapLayerPtr()->getBlockPtrByCoordinates(point_G);
+    const Block<MOVoxel> *mo_block_ptr = map_->getMapBlockPtrByIndex(
+        getGridIndexFromPoint<BlockIndex>(point_G, block_size_inv_));
 
     if (mo_block_ptr) {
       // Get the id of the currently active object at this 3D position.
       const MOVoxel &mo_voxel = mo_block_ptr->getVoxelByCoordinates(point_G);
-      ObjectID object_id = mo_voxel.active_object.object_id;
+      ObjectID object_id = mo_voxel.active_object().object_id;
 
       if (object_id != EmptyID) {
         exists_overlapping_object = true;
 
         // Increase the overlap point count for this object-segment pair.
         constexpr size_t count = 1u;
-        increaseOverlapCount(object_id, segment, count, object_segment_overlap);
+        increaseOverlapCount(object_id, segment, count, segment_overlaps);
       }
     }
   }
@@ -62,58 +126,62 @@ void Integrator::computeObjectOverlap(
   if (!exists_overlapping_object) {
     ObjectID object_id = getFreshObjectId();
     const size_t count = segment->points_C_.size();
-    increaseOverlapCount(object_id, segment, count, object_segment_overlap);
+    increaseOverlapCount(object_id, segment, count, segment_overlaps);
   }
 }
 
-void Integrator::increaseOverlapCount(
-    const ObjectID object_id, Segment *segment, size_t count,
-    std::map<ObjectID, SegmentHistogram> *object_segment_overlap) {
+void Integrator::increaseOverlapCount(const ObjectID object_id,
+                                      Segment *segment, size_t count,
+                                      SegmentOverlapList *segment_overlaps) {
   CHECK_NOTNULL(segment);
-  CHECK_NOTNULL(object_segment_overlap);
-
-  auto object_it = object_segment_overlap->find(object_id);
-
-  if (object_it != object_segment_overlap->end()) {
-    auto segment_it = object_it->second.find(segment);
-    if (segment_it != object_it->second.end()) {
-      ++segment_it->second;
-    } else {
-      object_it->second.emplace(segment, count);
+  CHECK_NOTNULL(segment_overlaps);
+
+  // A segment overlaps with few objects, so its overlaps at the end of the
+  // list are searched linearly.
+  for (auto it = segment_overlaps->rbegin();
+       it != segment_overlaps->rend() && it->segment == segment; ++it) {
+    if (it->object_id == object_id) {
+      it->count += count;
+      return;
     }
-  } else {
-    SegmentHistogram segment_histogram;
-    segment_histogram.emplace(segment, count);
-    object_segment_overlap->emplace(object_id, segment_histogram);
   }
+
+  segment_overlaps->push_back({object_id, segment, count});
 }
 
-void Integrator::assignObjectIds(
-    std::vector<Segment *> *current_frame_segments,
-    std::map<ObjectID, SegmentHistogram> *object_segment_overlap,
-    std::map<ObjectID, Segment *> *object_merged_segments) {
-  CHECK_NOTNULL(object_segment_overlap);
+void Integrator::assignObjectIds(std::vector<Segment *> *current_frame_segments,
+                                 SegmentOverlapList *segment_overlaps,
+                                 std::vector<Segment *> *merged_segments) {
+  CHECK_NOTNULL(current_frame_segments);
+  CHECK_NOTNULL(segment_overlaps);
+  CHECK_NOTNULL(merged_segments);
 
-  std::set<Segment *> assigned_segments;
-  std::pair<Segment *, ObjectID> segment_object_pair;
+  // Segments are marked as not assigned yet by an EmptyID.
+  for (Segment *segment : *current_frame_segments) {
+    segment->object_id_ = EmptyID;
+  }
 
-  while (nextSegmentObjectPair(*object_segment_overlap, assigned_segments,
-                               &segment_object_pair)) {
-    Segment *segment = segment_object_pair.first;
-    CHECK_NOTNULL(segment);
-    ObjectID object_id = segment_object_pair.second;
+  SegmentOverlap segment_object_pair;
 
-    auto it = object_merged_segments->find(object_id);
-    if (it != object_merged_segments->end()) {
-      it->second->pointcloud_ += segment->pointcloud_;
+  while (nextSegmentObjectPair(*segment_overlaps, &segment_object_pair)) {
+    Segment *segment = segment_object_pair.segment;
+    CHECK_NOTNULL(segment);
+    ObjectID object_id = segment_object_pair.object_id;
+
+    auto it = std::find_if(merged_segments->begin(), merged_segments->end(),
+                           [object_id](const Segment *merged_segment) {
+                             return merged_segment->object_id_ == object_id;
+                           });
+    if (it != merged_segments->end()) {
+      (*it)->merge(*segment);
     } else {
-      segment->object_id_ = object_id;
-      object_merged_segments->emplace(object_id, segment);
+      merged_segments->push_back(segment);
     }
 
     // The segment has been assigned an object_id from the map.
-    assigned_segments.emplace(segment);
+    segment->object_id_ = object_id;
 
+    bool is_object_used_up = false;
     ObjectVolume *object_volume = map_->getObjectVolumePtrById(object_id);
 
     if (object_volume) {
@@ -121,117 +189,265 @@ void Integrator::assignObjectIds(
           object_volume->getSemanticClass() == BackgroundClass) {
         // This object_id can no longer be assigned
         // to another segment in the current frame.
-        object_segment_overlap->erase(object_id);
+        is_object_used_up = true;
       }
     }
+
+    segment_overlaps->erase(
+        std::remove_if(segment_overlaps->begin(), segment_overlaps->end(),
+                       [segment, object_id,
+                        is_object_used_up](const SegmentOverlap &overlap) {
+                         return overlap.segment == segment ||
+                                (is_object_used_up &&
+                                 overlap.object_id == object_id);
+                       }),
+        segment_overlaps->end());
   }
 
   // All segments which have not been assigned an object_id among their
   // overlapping map objects are assigned a new, previously unseen object_id.
   for (Segment *segment : *current_frame_segments) {
-    if (assigned_segments.find(segment) == assigned_segments.end()) {
+    if (segment->object_id_ == EmptyID) {
       segment->object_id_ = getFreshObjectId();
-      assigned_segments.emplace(segment);
-      object_merged_segments->emplace(segment->object_id_, segment);
+      merged_segments->push_back(segment);
     }
   }
 }
 
 bool Integrator::nextSegmentObjectPair(
-    const std::map<ObjectID, SegmentHistogram> &object_segment_overlap,
-    const std::set<Segment *> &assigned_segments,
-    std::pair<Segment *, ObjectID> *segment_object_pair) {
+    const SegmentOverlapList &segment_overlaps,
+    SegmentOverlap *segment_object_pair) {
+  CHECK_NOTNULL(segment_object_pair);
+
   size_t max_overlap_count = 0u;
-  ObjectID max_object_id;
-  Segment *max_segment;
-
-  for (auto const &object_pair : object_segment_overlap) {
-    ObjectID object_id = object_pair.first;
-    for (auto const &segment_pair : object_pair.second) {
-      Segment *segment = segment_pair.first;
-      size_t overlap_count = segment_pair.second;
-
-      float overlap_ratio =
-          (float)overlap_count / max_segment->points_C_.size();
-
-      bool is_assigned =
-          assigned_segments.find(segment) != assigned_segments.end();
-      bool is_greater_than_max = overlap_count > max_overlap_count;
-      bool is_greater_than_min = overlap_ratio > config_.min_overlap_ratio;
-      is_greater_than_min = true;
-
-      if (!is_assigned && is_greater_than_max && is_greater_than_min) {
-        max_overlap_count = overlap_count;
-        max_object_id = object_id;
-        max_segment = segment;
-      }
+
+  for (const SegmentOverlap &overlap : segment_overlaps) {
+    float overlap_ratio =
+        (float)overlap.count / overlap.segment->points_C_.size();
+
+    bool is_greater_than_max = overlap.count > max_overlap_count;
+    bool is_greater_than_min = overlap_ratio > config_.min_overlap_ratio;
+    is_greater_than_min = true;
+
+    if (is_greater_than_max && is_greater_than_min) {
+      max_overlap_count = overlap.count;
+      *segment_object_pair = overlap;
     }
   }
 
-  if (!max_overlap_count) {
-    return false;
-  }
+  return max_overlap_count > 0u;
+}
 
-  segment_object_pair->first = max_segment;
-  segment_object_pair->second = max_object_id;
+template <unsigned kFlags>
+void Integrator::dispatchIntegrateSegment(const Segment &segment,
+                                          bool concurrent, size_t thread_idx) {
+  if (kernel_flags_ != kFlags) {
+    dispatchIntegrateSegment<kFlags - 1u>(segment, concurrent, thread_idx);
+  } else if (concurrent) {
+    integrateSegmentKernelConcurrent<kFlags>(segment,
+                                             thread_buffers_[thread_idx].get());
+  } else {
+    integrateSegmentKernel<kFlags>(segment);
+  }
+}
 
-  return true;
+template <>
+void Integrator::dispatchIntegrateSegment<0u>(const Segment &segment,
+                                              bool concurrent,
+                                              size_t thread_idx) {
+  if (concurrent) {
+    integrateSegmentKernelConcurrent<0u>(segment,
+                                         thread_buffers_[thread_idx].get());
+  } else {
+    integrateSegmentKernel<0u>(segment);
+  }
 }
 
 void Integrator::integrateSegment(const Segment &segment) {
-  timing::Timer integrate_segment_timer("integrate/segment");
-  CHECK_EQ(segment.points_C_.size(), segment.colors_.size());
+  constexpr bool concurrent = false;
+  constexpr size_t thread_idx = 0u;
+  dispatchIntegrateSegment<kNumKernels - 1u>(segment, concurrent, thread_idx);
+
+  recordObservation(segment);
+}
+
+void Integrator::integrateSegments(const std::vector<Segment *> &segments) {
+  small_segments_.clear();
+
+  // Synchronizing threads for the few rays of a small segment costs more than
+  // integrating them, so only large segments are integrated with all threads.
+  for (Segment *segment : segments) {
+    CHECK_NOTNULL(segment);
+    if (config_.integrator_threads == 1u ||
+        segment->points_C_.size() >= config_.large_segment_min_points) {
+      integrateSegment(*segment);
+    } else {
+      small_segments_.push_back(segment);
+    }
+  }
+
+  if (small_segments_.empty()) {
+    return;
+  }
+
+  timing::Timer integrate_segments_timer(kConcurrentSegmentsTimerTag);
+
+  const size_t num_threads =
+      std::min(config_.integrator_threads, small_segments_.size());
+  std::atomic<size_t> next_segment_idx(0u);
+
+  worker_pool_->run(num_threads, [this, &next_segment_idx](size_t thread_idx) {
+    integrateSegmentsConcurrent(small_segments_, &next_segment_idx,
+                                thread_idx);
+  });
+
+  timing::Timer insertion_timer(kInsertBlocksTimerTag);
+  updateLayerWithStoredBlocks();
 
-  // Pre-compute a list of unique voxels to end on.
-  // Create a hashmap: VOXEL INDEX -> index in original cloud.
-  LongIndexHashMapType<AlignedVector<size_t>>::type voxel_map;
-  // This is a hash map (same as above) to all the indices that need to be
-  // cleared.
-  LongIndexHashMapType<AlignedVector<size_t>>::type clear_map;
+  insertion_timer.Stop();
+
+  for (const Segment *segment : small_segments_) {
+    recordObservation(*segment);
+  }
+
+  integrate_segments_timer.Stop();
+}
+
+void Integrator::recordObservation(const Segment &segment) {
+  ObjectVolume *object_volume =
+      map_->getObjectVolumePtrById(segment.object_id_);
+
+  if (object_volume != nullptr) {
+    object_volume->recordObservation();
+  }
+}
+
+ObjectVolume *Integrator::allocateObjectVolume(const Segment &segment) {
+  ObjectVolume *object_volume =
+      map_->getObjectVolumePtrById(segment.object_id_);
+  if (object_volume != nullptr) {
+    return object_volume;
+  }
+
+  // Extent of the segment as the diagonal of the bounding box of its points.
+  Point min_point = Point::Constant(std::numeric_limits<FloatingPoint>::max());
+  Point max_point = -min_point;
+  for (const Point &point_C : segment.points_C_) {
+    bool is_clearing;
+    if (!isPointValid(point_C, &is_clearing) || is_clearing) {
+      continue;
+    }
+    min_point = min_point.cwiseMin(point_C);
+    max_point = max_point.cwiseMax(point_C);
+  }
+  const float extent =
+      (min_point.x() <= max_point.x()) ? (max_point - min_point).norm() : 0.0f;
 
-  std::unique_ptr<ThreadSafeIndex> index_getter(ThreadSafeIndexFactory::get(
-      config_.integration_order_mode, segment.points_C_));
+  return map_->allocateObjectVolumePtrById(
+      segment.centroid_, segment.semantic_class_, segment.object_id_, extent);
+}
 
-  timing::Timer bundle_timer("integrate/1_bundle_rays");
+void Integrator::integrateSegmentsConcurrent(
+    const std::vector<Segment *> &segments,
+    std::atomic<size_t> *next_segment_idx, size_t thread_idx) {
+  CHECK_NOTNULL(next_segment_idx);
 
-  bundleRays(segment.T_G_C_, segment.points_C_, index_getter.get(), &voxel_map,
-             &clear_map);
+  constexpr bool concurrent = true;
+  size_t segment_idx;
+  while ((segment_idx = next_segment_idx->fetch_add(1u)) < segments.size()) {
+    dispatchIntegrateSegment<kNumKernels - 1u>(*segments[segment_idx],
+                                               concurrent, thread_idx);
+  }
+}
+
+template <unsigned kFlags>
+void Integrator::integrateSegmentKernel(const Segment &segment) {
+  timing::Timer integrate_segment_timer(kSegmentTimerTag);
+  if (!(kFlags & kNoColor)) {
+    CHECK_EQ(segment.points_C_.size(), segment.colors_.size());
+  }
+
+  // The calling thread is thread 0 of the worker pool.
+  ThreadBuffers *buffers = thread_buffers_[0].get();
+
+  timing::Timer bundle_timer(kBundleRaysTimerTag);
+
+  bundleRays(segment.T_G_C_, segment.points_C_, kFlags & kAntiGrazing,
+             buffers);
 
   bundle_timer.Stop();
 
-  timing::Timer integrate_rays_timer("integrate/2_integrate_rays");
+  timing::Timer integrate_rays_timer(kIntegrateRaysTimerTag);
+
+  const float truncation_distance =
+      getTruncationDistance(*allocateObjectVolume(segment));
 
-  bool is_clearing_ray = false;
-  integrateRays(segment.T_G_C_, segment.points_C_, segment.centroid_,
-                segment.object_id_, segment.semantic_class_, segment.colors_,
-                config_.enable_anti_grazing, is_clearing_ray, voxel_map,
-                clear_map);
+  integrateRays<kFlags>(segment.T_G_C_, segment.points_C_, segment.centroid_,
+                        segment.object_id_, segment.semantic_class_,
+                        segment.colors_, truncation_distance, buffers,
+                        config_.integrator_threads);
 
   integrate_rays_timer.Stop();
 
-  timing::Timer clear_timer("integrate/3_clear");
+  timing::Timer insertion_timer(kInsertBlocksTimerTag);
+  updateLayerWithStoredBlocks();
 
-  is_clearing_ray = true;
-  integrateRays(segment.T_G_C_, segment.points_C_, segment.centroid_,
-                segment.object_id_, segment.semantic_class_, segment.colors_,
-                config_.enable_anti_grazing, is_clearing_ray, voxel_map,
-                clear_map);
+  insertion_timer.Stop();
+
+  timing::Timer clear_timer(kClearTimerTag);
+
+  if (!buffers->clear_bundles.empty()) {
+    integrateClearingRays<kFlags>(segment.T_G_C_, segment.points_C_, *buffers,
+                                  config_.integrator_threads);
+  }
 
   clear_timer.Stop();
 
   integrate_segment_timer.Stop();
 }
 
-void Integrator::bundleRays(
-    const Transformation &T_G_C, const Pointcloud &points_C,
-    ThreadSafeIndex *index_getter,
-    LongIndexHashMapType<AlignedVector<size_t>>::type *voxel_map,
-    LongIndexHashMapType<AlignedVector<size_t>>::type *clear_map) {
-  CHECK(voxel_map != nullptr);
-  CHECK(clear_map != nullptr);
-
-  size_t point_idx;
-  while (index_getter->getNextIndex(&point_idx)) {
+template <unsigned kFlags>
+void Integrator::integrateSegmentKernelConcurrent(const Segment &segment,
+                                                  ThreadBuffers *buffers) {
+  CHECK_NOTNULL(buffers);
+  if (!(kFlags & kNoColor)) {
+    CHECK_EQ(segment.points_C_.size(), segment.colors_.size());
+  }
+
+  // No timers here, they would be shared by all the segments in flight.
+  constexpr size_t num_threads = 1u;
+
+  bundleRays(segment.T_G_C_, segment.points_C_, kFlags & kAntiGrazing,
+             buffers);
+
+  const float truncation_distance =
+      getTruncationDistance(*allocateObjectVolume(segment));
+
+  integrateRays<kFlags>(segment.T_G_C_, segment.points_C_, segment.centroid_,
+                        segment.object_id_, segment.semantic_class_,
+                        segment.colors_, truncation_distance, buffers,
+                        num_threads);
+
+  // The blocks allocated by the segments in flight are only merged once all
+  // of them are integrated, hence clearing rays skip them in this frame.
+  if (!buffers->clear_bundles.empty()) {
+    integrateClearingRays<kFlags>(segment.T_G_C_, segment.points_C_, *buffers,
+                                  num_threads);
+  }
+}
+
+void Integrator::bundleRays(const Transformation &T_G_C,
+                            const Pointcloud &points_C, bool anti_grazing,
+                            ThreadBuffers *buffers) {
+  CHECK_NOTNULL(buffers);
+
+  buffers->voxel_bundles.clear();
+  buffers->clear_bundles.clear();
+  buffers->endpoint_mask.clear();
+
+  // The points are visited in order, the order only
+  // matters for the merging of the points within a bundle.
+  for (size_t point_idx = 0u; point_idx < points_C.size(); ++point_idx) {
     const Point &point_C = points_C[point_idx];
     bool is_clearing;
     if (!isPointValid(point_C, &is_clearing)) {
@@ -244,89 +460,85 @@ void Integrator::bundleRays(
         getGridIndexFromPoint<GlobalIndex>(point_G, voxel_size_inv_);
 
     if (is_clearing) {
-      (*clear_map)[voxel_index].push_back(point_idx);
+      buffers->clear_bundles.add(voxel_index, point_idx);
     } else {
-      (*voxel_map)[voxel_index].push_back(point_idx);
+      buffers->voxel_bundles.add(voxel_index, point_idx);
+
+      if (anti_grazing) {
+        buffers->endpoint_mask.insert(voxel_index);
+      }
     }
   }
 
+  buffers->voxel_bundles.finalize();
+  buffers->clear_bundles.finalize();
+
   VLOG(3) << "Went from " << points_C.size() << " points to "
-          << voxel_map->size() << " raycasts  and " << clear_map->size()
-          << " clear rays.";
+          << buffers->voxel_bundles.size() << " raycasts  and "
+          << buffers->clear_bundles.size() << " clear rays.";
 }
 
-void Integrator::integrateRays(
-    const Transformation &T_G_C, const Pointcloud &points_C,
-    const Point centroid, const ObjectID &object_id,
-    const SemanticClass &semantic_class, const Colors &colors,
-    bool enable_anti_grazing, bool clearing_ray,
-    const LongIndexHashMapType<AlignedVector<size_t>>::type &voxel_map,
-    const LongIndexHashMapType<AlignedVector<size_t>>::type &clear_map) {
-  // If only 1 thread just do function call, otherwise spawn threads.
-  if (config_.integrator_threads == 1) {
+template <unsigned kFlags>
+void Integrator::integrateRays(const Transformation &T_G_C,
+                               const Pointcloud &points_C,
+                               const Point centroid, const ObjectID &object_id,
+                               const SemanticClass &semantic_class,
+                               const Colors &colors,
+                               const float truncation_distance,
+                               ThreadBuffers *buffers, size_t num_threads) {
+  CHECK_NOTNULL(buffers);
+
+  // If only 1 thread just do function call, otherwise run on the pool.
+  if (num_threads == 1) {
     constexpr size_t thread_idx = 0u;
-    integrateVoxels(T_G_C, points_C, centroid, object_id, semantic_class,
-                    colors, enable_anti_grazing, clearing_ray, voxel_map,
-                    clear_map, thread_idx);
+    integrateVoxels<kFlags>(T_G_C, points_C, centroid, object_id,
+                            semantic_class, colors, truncation_distance,
+                            buffers->voxel_bundles, buffers->endpoint_mask,
+                            &buffers->voxel_run, thread_idx, num_threads);
   } else {
-    std::list<std::thread> integration_threads;
-
-    for (size_t i = 0u; i < config_.integrator_threads; ++i) {
-      integration_threads.emplace_back(
-          &Integrator::integrateVoxels, this, T_G_C, std::cref(points_C),
-          centroid, object_id, semantic_class, std::cref(colors),
-          enable_anti_grazing, clearing_ray, std::cref(voxel_map),
-          std::cref(clear_map), i);
-    }
-
-    for (std::thread &thread : integration_threads) {
-      thread.join();
-    }
+    worker_pool_->run(num_threads, [&](size_t thread_idx) {
+      integrateVoxels<kFlags>(T_G_C, points_C, centroid, object_id,
+                              semantic_class, colors, truncation_distance,
+                              buffers->voxel_bundles, buffers->endpoint_mask,
+                              &thread_buffers_[thread_idx]->voxel_run,
+                              thread_idx, num_threads);
+    });
   }
-
-  timing::Timer insertion_timer("integrate/insert_blocks");
-  updateLayerWithStoredBlocks();
-
-  insertion_timer.Stop();
 }
 
+template <unsigned kFlags>
 void Integrator::integrateVoxels(
     const Transformation &T_G_C, const Pointcloud &points_C,
     const Point centroid, const ObjectID &object_id,
     const SemanticClass &semantic_class, const Colors &colors,
-    bool enable_anti_grazing, bool clearing_ray,
-    const LongIndexHashMapType<AlignedVector<size_t>>::type &voxel_map,
-    const LongIndexHashMapType<AlignedVector<size_t>>::type &clear_map,
-    size_t thread_idx) {
-  LongIndexHashMapType<AlignedVector<size_t>>::type::const_iterator it;
-  size_t map_size;
-  if (clearing_ray) {
-    it = clear_map.begin();
-    map_size = clear_map.size();
-  } else {
-    it = voxel_map.begin();
-    map_size = voxel_map.size();
-  }
-
-  for (size_t i = 0u; i < map_size; ++i) {
-    if (((i + thread_idx + 1u) % config_.integrator_threads) == 0u) {
-      integrateVoxel(T_G_C, points_C, centroid, object_id, semantic_class,
-                     colors, enable_anti_grazing, clearing_ray, *it, voxel_map);
+    const float truncation_distance, const RayBundles &voxel_bundles,
+    const VoxelBitmask &endpoint_mask, BlockRayCaster::VoxelRun *voxel_run,
+    size_t thread_idx, size_t num_threads) {
+  for (size_t i = 0u; i < voxel_bundles.size(); ++i) {
+    if (((i + thread_idx + 1u) % num_threads) == 0u) {
+      integrateVoxel<kFlags>(T_G_C, points_C, centroid, object_id,
+                             semantic_class, colors, truncation_distance,
+                             voxel_bundles, i, endpoint_mask, voxel_run);
     }
-    ++it;
   }
 }
 
+template <unsigned kFlags>
 void Integrator::integrateVoxel(
     const Transformation &T_G_C, const Pointcloud &points_C,
     const Point centroid, const ObjectID &object_id,
     const SemanticClass &semantic_class, const Colors &colors,
-    bool enable_anti_grazing, bool clearing_ray,
-    const std::pair<GlobalIndex, AlignedVector<size_t>> &kv,
-    const LongIndexHashMapType<AlignedVector<size_t>>::type &voxel_map) {
-  if (kv.second.empty()) {
+    const float truncation_distance, const RayBundles &voxel_bundles,
+    size_t bundle_idx, const VoxelBitmask &endpoint_mask,
+    BlockRayCaster::VoxelRun *voxel_run) {
+  CHECK_NOTNULL(voxel_run);
+
+  const RayBundles::PointRange bundle_points =
+      voxel_bundles.getPoints(bundle_idx);
+  if (bundle_points.empty()) {
     return;
   }
+  const GlobalIndex &bundle_voxel_idx = voxel_bundles.getVoxelIndex(bundle_idx);
 
   const Point &origin = T_G_C.getPosition();
   Color merged_color;
@@ -336,9 +548,8 @@ void Integrator::integrateVoxel(
   // and select the max occurring object_id.
   ObjectID merged_object_id = object_id;
 
-  for (const size_t pt_idx : kv.second) {
+  for (const size_t pt_idx : bundle_points) {
     const Point &point_C = points_C[pt_idx];
-    const Color &color = colors[pt_idx];
 
     const float point_weight = getVoxelWeight(point_C);
     if (point_weight < kEpsilon) {
@@ -346,108 +557,252 @@ void Integrator::integrateVoxel(
     }
     merged_point_C = (merged_point_C * merged_weight + point_C * point_weight) /
                      (merged_weight + point_weight);
-    merged_color =
-        Color::blendTwoColors(merged_color, merged_weight, color, point_weight);
-    merged_weight += point_weight;
-
-    // Only take the first point when clearing.
-    if (clearing_ray) {
-      break;
+    if (!(kFlags & kNoColor)) {
+      merged_color = Color::blendTwoColors(merged_color, merged_weight,
+                                           colors[pt_idx], point_weight);
     }
+    merged_weight += point_weight;
   }
 
   const Point merged_point_G = T_G_C * merged_point_C;
 
-  RayCaster ray_caster(origin, merged_point_G, clearing_ray,
-                       config_.voxel_carving_enabled, config_.max_ray_length_m,
-                       voxel_size_inv_, config_.truncation_distance);
-
-  Block<MOVoxel>::Ptr block = nullptr;
-  BlockIndex block_idx;
+  constexpr bool is_clearing_ray = false;
+  BlockRayCaster ray_caster(origin, merged_point_G, is_clearing_ray,
+                            config_.voxel_carving_enabled,
+                            config_.max_ray_length_m, voxel_size_inv_,
+                            truncation_distance, voxel_indexer_);
 
   ObjectID last_object_id;
   ObjectVolume *last_object_volume = nullptr;
 
-  // The pair block_idx and block of either layer must be updated together,
-  // else it is invalid. Therefore, keep a separate pair for the TsdfVoxel.
-  Block<TsdfVoxel>::Ptr tsdf_block = nullptr;
+  // The TSDF block and its index must be updated together, else the cache
+  // is invalid. Blocks of the map layer are instead fetched once per run.
+  Block<TsdfVoxel> *tsdf_block = nullptr;
   BlockIndex last_tsdf_block_idx;
+  TsdfVoxel *last_tsdf_voxel = nullptr;
+
+  VoxelBitmask::Cache endpoint_mask_cache;
+
+  // Map block of the next run, looked up while prefetching it such that each
+  // run costs a single lookup. The map layer is not modified during the
+  // integration, new blocks only go to temp_block_map_.
+  Block<MOVoxel> *next_block = nullptr;
+  bool next_block_looked_up = false;
+
+  while (ray_caster.nextRun(voxel_run)) {
+    Block<MOVoxel> *block = next_block_looked_up
+                                ? next_block
+                                : map_->getMapBlockPtrByIndex(
+                                      voxel_run->block_idx);
+    // Blocks missing from the map are only allocated once a voxel of the run
+    // is actually updated.
+    bool block_updated = false;
+
+    // Start loading the next block while the voxels of this one are updated.
+    next_block_looked_up = ray_caster.hasNextRun();
+    if (next_block_looked_up) {
+      next_block = map_->getMapBlockPtrByIndex(ray_caster.getNextBlockIndex());
+      if (next_block != nullptr) {
+        __builtin_prefetch(
+            &next_block->getVoxelByLinearIndex(ray_caster.getNextLinearIndex()));
+      }
+    }
 
-  GlobalIndex global_voxel_idx;
-  while (ray_caster.nextRayIndex(&global_voxel_idx)) {
-    if (enable_anti_grazing) {
-      // Check if this one is already the the block hash map for this
-      // insertion. Skip this to avoid grazing.
-      if ((clearing_ray || global_voxel_idx != kv.first) &&
-          voxel_map.find(global_voxel_idx) != voxel_map.end()) {
-        continue;
+    for (size_t i = 0u; i < voxel_run->size(); ++i) {
+      const GlobalIndex &global_voxel_idx = voxel_run->global_voxel_indices[i];
+
+      if (kFlags & kAntiGrazing) {
+        // Check if this one is already the the block hash map for this
+        // insertion. Skip this to avoid grazing.
+        if (global_voxel_idx != bundle_voxel_idx &&
+            endpoint_mask.contains(global_voxel_idx, &endpoint_mask_cache)) {
+          continue;
+        }
+      }
+
+      if (!block_updated) {
+        if (block == nullptr) {
+          block = allocateStorageAndGetBlockPtr(voxel_run->block_idx);
+        }
+        block->updated().set();
+        block_updated = true;
       }
+
+      MOVoxel *voxel =
+          &block->getVoxelByLinearIndex(voxel_run->linear_indices[i]);
+
+      updateMOVoxel<kFlags>(centroid, semantic_class, origin, merged_point_G,
+                            merged_object_id, global_voxel_idx, merged_color,
+                            merged_weight, truncation_distance, voxel,
+                            &last_object_volume, &last_object_id, &tsdf_block,
+                            &last_tsdf_block_idx, &last_tsdf_voxel);
     }
+  }
+}
 
-    MOVoxel *voxel =
-        allocateStorageAndGetVoxelPtr(global_voxel_idx, &block, &block_idx);
+template <unsigned kFlags>
+void Integrator::integrateClearingRays(const Transformation &T_G_C,
+                                       const Pointcloud &points_C,
+                                       const ThreadBuffers &buffers,
+                                       size_t num_threads) {
+  // If only 1 thread just do function call, otherwise run on the pool.
+  if (num_threads == 1) {
+    constexpr size_t thread_idx = 0u;
+    clearVoxels<kFlags>(T_G_C, points_C, buffers.clear_bundles,
+                        buffers.endpoint_mask, thread_idx, num_threads);
+  } else {
+    worker_pool_->run(num_threads, [&](size_t thread_idx) {
+      clearVoxels<kFlags>(T_G_C, points_C, buffers.clear_bundles,
+                          buffers.endpoint_mask, thread_idx, num_threads);
+    });
+  }
+}
 
-    updateMOVoxel(centroid, semantic_class, origin, merged_point_G,
-                  merged_object_id, global_voxel_idx, merged_color,
-                  merged_weight, voxel, &last_object_volume, &last_object_id,
-                  &tsdf_block, &last_tsdf_block_idx);
+template <unsigned kFlags>
+void Integrator::clearVoxels(const Transformation &T_G_C,
+                             const Pointcloud &points_C,
+                             const RayBundles &clear_bundles,
+                             const VoxelBitmask &endpoint_mask,
+                             size_t thread_idx, size_t num_threads) {
+  for (size_t i = 0u; i < clear_bundles.size(); ++i) {
+    if (((i + thread_idx + 1u) % num_threads) == 0u) {
+      // Only take the first point when clearing.
+      for (const size_t pt_idx : clear_bundles.getPoints(i)) {
+        const float point_weight = getVoxelWeight(points_C[pt_idx]);
+        if (point_weight < kEpsilon) {
+          continue;
+        }
+
+        clearRay<kFlags>(T_G_C, points_C[pt_idx], point_weight,
+                         endpoint_mask);
+        break;
+      }
+    }
   }
 }
 
-MOVoxel *
-Integrator::allocateStorageAndGetVoxelPtr(const GlobalIndex &global_voxel_idx,
-                                          Block<MOVoxel>::Ptr *last_block,
-                                          BlockIndex *last_block_idx) {
-  CHECK_NOTNULL(last_block);
-  CHECK_NOTNULL(last_block_idx);
+template <unsigned kFlags>
+void Integrator::clearRay(const Transformation &T_G_C, const Point &point_C,
+                          const float weight,
+                          const VoxelBitmask &endpoint_mask) {
+  const Point &origin = T_G_C.getPosition();
+  const Point point_G = T_G_C * point_C;
 
-  const BlockIndex block_idx =
-      getBlockIndexFromGlobalVoxelIndex(global_voxel_idx, voxels_per_side_inv_);
+  // Same extent as a voxblox clearing ray, which always
+  // starts at the origin as allow_clear requires carving.
+  const Ray unit_ray = (point_G - origin).normalized();
+  FloatingPoint ray_length = (point_G - origin).norm();
+  ray_length = std::min(
+      std::max(ray_length - config_.truncation_distance, 0.0f),
+      config_.max_ray_length_m);
+  const Point ray_end = origin + unit_ray * ray_length;
 
-  if ((block_idx != *last_block_idx) || (*last_block == nullptr)) {
-    *last_block = map_->getMapLayerPtr()->getBlockPtrByIndex(block_idx);
-    *last_block_idx = block_idx;
-  }
+  ObjectID last_object_id;
+  ObjectVolume *last_object_volume = nullptr;
+  Block<TsdfVoxel> *tsdf_block = nullptr;
+  BlockIndex last_tsdf_block_idx;
+  TsdfVoxel *last_tsdf_voxel = nullptr;
 
-  // If no block at this location currently exists, we allocate a temporary
-  // voxel that will be merged into the map later
-  if (*last_block == nullptr) {
-    // To allow temp_block_map_ to grow we can only let one thread in at once
-    std::lock_guard<std::mutex> lock(temp_block_mutex_);
-
-    typename Layer<MOVoxel>::BlockHashMap::iterator it =
-        temp_block_map_.find(block_idx);
-    if (it != temp_block_map_.end()) {
-      *last_block = it->second;
-    } else {
-      auto insert_status = temp_block_map_.emplace(
-          block_idx, std::make_shared<Block<MOVoxel>>(
-                         voxels_per_side_, voxel_size_,
-                         getOriginPointFromGridIndex(block_idx, block_size_)));
+  VoxelBitmask::Cache endpoint_mask_cache;
+
+  // Traverse the blocks along the ray first. Blocks that are not allocated in
+  // the map layer have never been observed and there is nothing to carve in
+  // them, so they are skipped as a whole without visiting their voxels.
+  RayCaster block_ray_caster(origin * block_size_inv_,
+                             ray_end * block_size_inv_);
+
+  GlobalIndex global_block_idx;
+  while (block_ray_caster.nextRayIndex(&global_block_idx)) {
+    const BlockIndex block_idx = global_block_idx.cast<IndexElement>();
+
+    Block<MOVoxel> *mo_block = map_->getMapBlockPtrByIndex(block_idx);
+    if (mo_block == nullptr) {
+      continue;
+    }
+
+    // Clip the ray to the block (slab method), then traverse its voxels.
+    const Point block_min = getOriginPointFromGridIndex(block_idx, block_size_);
+    const Point block_max = block_min + Point::Constant(block_size_);
+    const Ray ray = ray_end - origin;
+
+    FloatingPoint t_enter = 0.0f;
+    FloatingPoint t_exit = 1.0f;
+    for (unsigned int i = 0u; i < 3u; ++i) {
+      if (std::abs(ray(i)) < kEpsilon) {
+        continue;
+      }
+      FloatingPoint t_min = (block_min(i) - origin(i)) / ray(i);
+      FloatingPoint t_max = (block_max(i) - origin(i)) / ray(i);
+      if (t_min > t_max) {
+        std::swap(t_min, t_max);
+      }
+      t_enter = std::max(t_enter, t_min);
+      t_exit = std::min(t_exit, t_max);
+    }
+
+    if (t_enter > t_exit) {
+      continue;
+    }
+
+    RayCaster voxel_ray_caster((origin + t_enter * ray) * voxel_size_inv_,
+                               (origin + t_exit * ray) * voxel_size_inv_);
+
+    GlobalIndex global_voxel_idx;
+    while (voxel_ray_caster.nextRayIndex(&global_voxel_idx)) {
+      // Voxels on the block boundary are visited with the neighboring block.
+      if (voxel_indexer_.getBlockIndex(global_voxel_idx) != block_idx) {
+        continue;
+      }
 
-      CHECK(insert_status.second) << "Block already exists when allocating at "
-                                  << block_idx.transpose();
+      if (kFlags & kAntiGrazing) {
+        if (endpoint_mask.contains(global_voxel_idx, &endpoint_mask_cache)) {
+          continue;
+        }
+      }
 
-      *last_block = insert_status.first->second;
+      clearMOVoxel(global_voxel_idx, weight,
+                   &(mo_block->getVoxelByLinearIndex(
+                       voxel_indexer_.getLinearIndex(global_voxel_idx))),
+                   &last_object_volume, &last_object_id, &tsdf_block,
+                   &last_tsdf_block_idx, &last_tsdf_voxel);
     }
   }
+}
 
-  (*last_block)->updated().set();
+Block<MOVoxel> *
+Integrator::allocateStorageAndGetBlockPtr(const BlockIndex &block_idx) {
+  Block<MOVoxel> *block = map_->getMapBlockPtrByIndex(block_idx);
+  if (block != nullptr) {
+    return block;
+  }
+
+  // If no block at this location currently exists, we allocate a temporary
+  // block that will be merged into the map later.
+  // To allow temp_block_map_ to grow we can only let one thread in at once
+  std::lock_guard<std::mutex> lock(temp_block_mutex_);
+
+  typename Layer<MOVoxel>::BlockHashMap::iterator it =
+      temp_block_map_.find(block_idx);
+  if (it != temp_block_map_.end()) {
+    return it->second.get();
+  }
 
-  const VoxelIndex local_voxel_idx =
-      getLocalFromGlobalVoxelIndex(global_voxel_idx, voxels_per_side_);
+  auto insert_status = temp_block_map_.emplace(
+      block_idx, std::make_shared<Block<MOVoxel>>(
+                     voxels_per_side_, voxel_size_,
+                     getOriginPointFromGridIndex(block_idx, block_size_)));
 
-  return &((*last_block)->getVoxelByVoxelIndex(local_voxel_idx));
+  CHECK(insert_status.second) << "Block already exists when allocating at "
+                              << block_idx.transpose();
+
+  return insert_status.first->second.get();
 }
 
 // NOT thread safe.
 void Integrator::updateLayerWithStoredBlocks() {
-  BlockIndex last_block_idx;
-  Block<MOVoxel>::Ptr block = nullptr;
-
   for (const std::pair<const BlockIndex, Block<MOVoxel>::Ptr> &temp_block_pair :
        temp_block_map_) {
-    map_->getMapLayerPtr()->insertBlock(temp_block_pair);
+    map_->insertMapBlock(temp_block_pair);
   }
 
   temp_block_map_.clear();
@@ -461,13 +816,15 @@ void Integrator::updateLayerWithStoredBlocks() {
 }
 
 // Updates map layer voxel and corresponding object volume voxel. Thread safe.
+template <unsigned kFlags>
 void Integrator::updateMOVoxel(
     const Point centroid, const SemanticClass &semantic_class,
     const Point &origin, const Point &point_G, const ObjectID &object_id,
     const GlobalIndex &global_voxel_idx, const Color &color, const float weight,
-    MOVoxel *mo_voxel, ObjectVolume **last_object_volume,
-    ObjectID *last_object_id, Block<TsdfVoxel>::Ptr *last_tsdf_block,
-    BlockIndex *last_tsdf_block_idx) {
+    const float truncation_distance, MOVoxel *mo_voxel,
+    ObjectVolume **last_object_volume,
+    ObjectID *last_object_id, Block<TsdfVoxel> **last_tsdf_block,
+    BlockIndex *last_tsdf_block_idx, TsdfVoxel **last_tsdf_voxel) {
   CHECK(mo_voxel != nullptr);
 
   const Point voxel_center =
@@ -475,65 +832,53 @@ void Integrator::updateMOVoxel(
 
   const float sdf = computeDistance(origin, point_G, voxel_center);
 
-  float updated_weight = weight;
-  // Compute updated weight in case we use weight dropoff. It's easier here
-  // that in getVoxelWeight as here we have the actual SDF for the voxel
-  // already computed.
-  const FloatingPoint dropoff_epsilon = voxel_size_;
-  if (config_.use_weight_dropoff && sdf < -dropoff_epsilon) {
-    updated_weight = weight * (config_.truncation_distance + sdf) /
-                     (config_.truncation_distance - dropoff_epsilon);
-    updated_weight = std::max(updated_weight, 0.0f);
-  }
-
-  // Compute the updated weight in case we compensate for sparsity. By
-  // multiplicating the weight of occupied areas (|sdf| < truncation distance)
-  // by a factor, we prevent to easily fade out these areas with the free
-  // space parts of other rays which pass through the corresponding voxels.
-  // This can be useful for creating a TSDF map from sparse sensor data (e.g.
-  // visual features from a SLAM system). By default, this option is disabled.
-  if (config_.use_sparsity_compensation_factor) {
-    if (std::abs(sdf) < config_.truncation_distance) {
-      updated_weight *= config_.sparsity_compensation_factor;
-    }
+  // Weight dropoff and sparsity compensation depend on the actual SDF of
+  // the voxel, which is only known here.
+  const float updated_weight =
+      weight * sensor_model_.getSdfFactor(sdf / truncation_distance);
+
+  // Free space beyond the truncation band only updates the global layer and
+  // the object blocks that already exist, object blocks are allocated
+  // close to the surface only.
+  if (sdf > truncation_distance) {
+    clearMOVoxel(global_voxel_idx, updated_weight, mo_voxel,
+                 last_object_volume, last_object_id, last_tsdf_block,
+                 last_tsdf_block_idx, last_tsdf_voxel);
+    return;
   }
 
   // Lookup the mutex that is responsible for this voxel and lock it.
-  std::lock_guard<std::mutex> lock(mutexes_.get(global_voxel_idx));
-
-  if (mo_voxel->active_object.object_id == 0u &&
-      mo_voxel->active_object.confidence != 0u) {
-    LOG(FATAL)
-        << "Encountered voxel which is set to object 0 but has confidence "
-        << mo_voxel->active_object.confidence;
-  }
+  std::lock_guard<std::mutex> lock(
+      mutexes_.get(getMutexIndex(global_voxel_idx)));
 
-  CHECK(mo_voxel->active_object.object_id != 0u ||
-        mo_voxel->active_object.confidence == 0u);
+  // Do the confidence increase and re-rank the objects
+  // to decide which object_id is active after this update.
+  mo_voxel->observeObject(object_id);
 
-  // Do the confidence increase/decrease and decide which
-  // object_id this voxel is assigned after this update.
-  if (mo_voxel->active_object.confidence == 0u) {
-    mo_voxel->active_object.object_id = object_id;
-    mo_voxel->active_object.confidence = 1;
-  } else {
-    if (mo_voxel->active_object.object_id == object_id) {
-      ++mo_voxel->active_object.confidence;
-    } else {
-      --mo_voxel->active_object.confidence;
-    }
-  }
-
-  if (mo_voxel->active_object.object_id == 0u) {
-    LOG(FATAL) << "Confidence got to: " << mo_voxel->active_object.confidence;
-  }
-
-  // TODO(margaritaG): experiment with mo_voxel->active_object.object_id for
+  // TODO(margaritaG): experiment with mo_voxel->active_object().object_id for
   // real-world segmentation.
   TsdfVoxel *tsdf_voxel = map_->allocateStorageAndGetVoxelPtr(
       centroid, semantic_class, object_id, global_voxel_idx, last_object_volume,
       last_object_id, last_tsdf_block, last_tsdf_block_idx);
 
+  // The map voxels of a coarser object voxel are consecutive along the ray,
+  // only the first of them updates it.
+  if (tsdf_voxel == *last_tsdf_voxel) {
+    return;
+  }
+  *last_tsdf_voxel = tsdf_voxel;
+
+  // Coarser object voxels are updated with the SDF at their own center.
+  float object_sdf = sdf;
+  const unsigned int voxel_scale_shift =
+      (*last_object_volume)->getVoxelScaleShift();
+  if (voxel_scale_shift > 0u) {
+    const Point object_voxel_center = getCenterPointFromGridIndex(
+        (*last_object_volume)->getObjectVoxelIndex(global_voxel_idx),
+        voxel_size_ * static_cast<float>(1u << voxel_scale_shift));
+    object_sdf = computeDistance(origin, point_G, object_voxel_center);
+  }
+
   const float new_weight = tsdf_voxel->weight + updated_weight;
 
   // It is possible to have weights very close to zero, due to the limited
@@ -543,17 +888,70 @@ void Integrator::updateMOVoxel(
   }
 
   const float new_sdf =
-      (sdf * updated_weight + tsdf_voxel->distance * tsdf_voxel->weight) /
+      (object_sdf * updated_weight +
+       tsdf_voxel->distance * tsdf_voxel->weight) /
       new_weight;
 
   // Color blending is expensive only do it close to the surface
-  if (std::abs(sdf) < config_.truncation_distance) {
+  if (!(kFlags & kNoColor) && std::abs(sdf) < truncation_distance) {
     tsdf_voxel->color = Color::blendTwoColors(
         tsdf_voxel->color, tsdf_voxel->weight, color, updated_weight);
   }
   tsdf_voxel->distance = (new_sdf > 0.0)
-                             ? std::min(config_.truncation_distance, new_sdf)
-                             : std::max(-config_.truncation_distance, new_sdf);
+                             ? std::min(truncation_distance, new_sdf)
+                             : std::max(-truncation_distance, new_sdf);
+  tsdf_voxel->weight = std::min(config_.max_weight, new_weight);
+}
+
+// Carves free space into the TSDF of the object active at mo_voxel and wears
+// down its confidence. Unlike updateMOVoxel, no color blending or allocation of
+// object blocks takes place. Thread safe.
+void Integrator::clearMOVoxel(const GlobalIndex &global_voxel_idx,
+                              const float weight, MOVoxel *mo_voxel,
+                              ObjectVolume **last_object_volume,
+                              ObjectID *last_object_id,
+                              Block<TsdfVoxel> **last_tsdf_block,
+                              BlockIndex *last_tsdf_block_idx,
+                              TsdfVoxel **last_tsdf_voxel) {
+  CHECK(mo_voxel != nullptr);
+  CHECK(last_tsdf_voxel != nullptr);
+
+  // Lookup the mutex that is responsible for this voxel and lock it.
+  std::lock_guard<std::mutex> lock(
+      mutexes_.get(getMutexIndex(global_voxel_idx)));
+
+  const ObjectID object_id = mo_voxel->active_object().object_id;
+  mo_voxel->observeFreeSpace();
+
+  if (object_id == EmptyID) {
+    return;
+  }
+
+  TsdfVoxel *tsdf_voxel = map_->getAllocatedTsdfVoxelPtr(
+      object_id, global_voxel_idx, last_object_volume, last_object_id,
+      last_tsdf_block, last_tsdf_block_idx);
+  if (tsdf_voxel == nullptr || tsdf_voxel == *last_tsdf_voxel) {
+    return;
+  }
+  *last_tsdf_voxel = tsdf_voxel;
+
+  const float new_weight = tsdf_voxel->weight + weight;
+
+  // It is possible to have weights very close to zero, due to the limited
+  // precision of floating points dividing by this small value can cause nans
+  if (new_weight < kFloatEpsilon) {
+    return;
+  }
+
+  // Free space is at least one truncation distance in
+  // front of the surface, so the SDF is always truncated.
+  const float truncation_distance =
+      getTruncationDistance(**last_object_volume);
+  const float new_sdf = (truncation_distance * weight +
+                         tsdf_voxel->distance * tsdf_voxel->weight) /
+                        new_weight;
+
+  tsdf_voxel->distance = std::min(truncation_distance, new_sdf);
   tsdf_voxel->weight = std::min(config_.max_weight, new_weight);
 }
 
@@ -574,15 +972,3 @@ float Integrator::computeDistance(const Point &origin, const Point &point_G,
   const float sdf = static_cast<float>(dist_G - dist_G_V);
   return sdf;
 }
-
-// Thread safe.
-float Integrator::getVoxelWeight(const Point &point_C) const {
-  if (config_.use_const_weight) {
-    return 1.0f;
-  }
-  const FloatingPoint dist_z = std::abs(point_C.z());
-  if (dist_z > kEpsilon) {
-    return 1.0f / (dist_z * dist_z);
-  }
-  return 0.0f;
-}
@@ -0,0 +1,92 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include "tsdf_plusplus/integrator/sensor_model.h"
+
+#include <glog/logging.h>
+
+SensorModel::SensorModel(const Config &config) : config_(config) {
+  CHECK_GT(config_.num_depth_bins, 0u);
+  CHECK_GT(config_.num_sdf_bins, 0u);
+
+  // Keep 1/z^2 finite at the near end of the table.
+  min_depth_ = std::max(config_.min_depth, kEpsilon);
+  max_depth_ = std::max(config_.max_depth, min_depth_ + kEpsilon);
+
+  const float num_depth_bins = static_cast<float>(config_.num_depth_bins);
+  depth_bins_per_m_ = num_depth_bins / (max_depth_ - min_depth_);
+  max_depth_bin_ = std::nextafter(num_depth_bins, 0.0f);
+
+  depth_weights_.resize(config_.num_depth_bins + 1u);
+  for (size_t bin = 0u; bin < depth_weights_.size(); ++bin) {
+    depth_weights_[bin] = computeDepthWeight(
+        min_depth_ + static_cast<float>(bin) / depth_bins_per_m_);
+  }
+
+  // The bins cover normalized SDFs in [-1, 1), each is evaluated at its
+  // center. One more entry for the voxels beyond the truncation band.
+  num_sdf_bins_ = static_cast<float>(config_.num_sdf_bins);
+  sdf_bins_per_unit_ = 0.5f * num_sdf_bins_;
+
+  sdf_factors_.resize(config_.num_sdf_bins + 1u);
+  for (size_t bin = 0u; bin < config_.num_sdf_bins; ++bin) {
+    sdf_factors_[bin] = computeSdfFactor(
+        (static_cast<float>(bin) + 0.5f) / sdf_bins_per_unit_ - 1.0f);
+  }
+  sdf_factors_.back() = 1.0f;
+}
+
+bool SensorModel::getDepthModelFromString(const std::string &name,
+                                          DepthModel *depth_model) {
+  CHECK_NOTNULL(depth_model);
+
+  if (name == "constant") {
+    *depth_model = DepthModel::kConstant;
+  } else if (name == "inverse_square") {
+    *depth_model = DepthModel::kInverseSquare;
+  } else if (name == "rgbd") {
+    *depth_model = DepthModel::kRgbdNoise;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+float SensorModel::computeDepthWeight(float z) const {
+  switch (config_.depth_model) {
+  case DepthModel::kConstant:
+    return 1.0f;
+  case DepthModel::kInverseSquare:
+    return 1.0f / (z * z);
+  case DepthModel::kRgbdNoise: {
+    const auto sigma = [this](float depth) {
+      const float offset = depth - config_.noise_c;
+      return config_.noise_a + config_.noise_b * offset * offset;
+    };
+    const float relative_sigma = sigma(z) / sigma(1.0f);
+    return 1.0f / (relative_sigma * relative_sigma);
+  }
+  }
+  LOG(FATAL) << "Unknown depth model.";
+  return 0.0f;
+}
+
+float SensorModel::computeSdfFactor(float normalized_sdf) const {
+  float factor = 1.0f;
+
+  if (config_.use_weight_dropoff && normalized_sdf < -config_.dropoff_epsilon) {
+    factor = std::max((1.0f + normalized_sdf) /
+                          (1.0f - config_.dropoff_epsilon),
+                      0.0f);
+  }
+
+  // By multiplicating the weight of occupied areas (|sdf| < truncation
+  // distance) by a factor, we prevent to easily fade out these areas with the
+  // free space parts of other rays which pass through the corresponding
+  // voxels.
+  if (config_.use_sparsity_compensation) {
+    factor *= config_.sparsity_compensation_factor;
+  }
+
+  return factor;
+}
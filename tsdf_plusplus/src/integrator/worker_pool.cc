@@ -0,0 +1,80 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include "tsdf_plusplus/integrator/worker_pool.h"
+
+WorkerPool::WorkerPool(size_t num_threads) {
+  CHECK_GT(num_threads, 0u);
+
+  workers_.reserve(num_threads - 1u);
+  for (size_t thread_idx = 1u; thread_idx < num_threads; ++thread_idx) {
+    workers_.emplace_back(&WorkerPool::workerLoop, this, thread_idx);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_condition_.notify_all();
+
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+void WorkerPool::runTask(size_t num_threads, const TaskBase &task) {
+  if (num_threads > 1u) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      task_num_threads_ = num_threads;
+      num_running_ = num_threads - 1u;
+      ++task_generation_;
+    }
+    task_condition_.notify_all();
+  }
+
+  constexpr size_t thread_idx = 0u;
+  task(thread_idx);
+
+  if (num_threads > 1u) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_condition_.wait(lock, [this] { return num_running_ == 0u; });
+    task_ = nullptr;
+  }
+}
+
+void WorkerPool::workerLoop(size_t thread_idx) {
+  uint64_t task_generation = 0u;
+
+  while (true) {
+    const TaskBase *task;
+    size_t task_num_threads;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_condition_.wait(lock, [this, task_generation] {
+        return stop_ || task_generation_ != task_generation;
+      });
+      if (stop_) {
+        return;
+      }
+      task_generation = task_generation_;
+      task = task_;
+      task_num_threads = task_num_threads_;
+    }
+
+    // Tasks using fewer threads than the pool leave the last workers idle.
+    if (thread_idx >= task_num_threads) {
+      continue;
+    }
+
+    (*task)(thread_idx);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--num_running_ == 0u) {
+      done_condition_.notify_one();
+    }
+  }
+}
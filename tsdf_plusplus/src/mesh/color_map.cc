@@ -24,3 +24,8 @@ void ColorMap::getColor(const ObjectID& object_id, voxblox::Color* color) {
     color_map_.insert(std::pair<ObjectID, voxblox::Color>(object_id, *color));
   }
 }
+
+void ColorMap::removeColor(const ObjectID& object_id) {
+  std::lock_guard<std::shared_timed_mutex> writerLock(color_map_mutex_);
+  color_map_.erase(object_id);
+}
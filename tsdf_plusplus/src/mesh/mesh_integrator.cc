@@ -52,7 +52,8 @@ void MOMeshIntegrator::initFromLayer(const Layer<MOVoxel> &map_layer) {
 }
 
 bool MOMeshIntegrator::generateMesh(bool only_mesh_updated_blocks,
-                                    bool clear_updated_flag) {
+                                    bool clear_updated_flag,
+                                    BlockIndexList *meshed_blocks) {
   BlockIndexList all_map_blocks;
   if (only_mesh_updated_blocks) {
     map_->getMapLayerPtr()->getAllUpdatedBlocks(Update::kMesh, &all_map_blocks);
@@ -83,6 +84,11 @@ bool MOMeshIntegrator::generateMesh(bool only_mesh_updated_blocks,
     thread.join();
   }
 
+  if (meshed_blocks != nullptr) {
+    meshed_blocks->insert(meshed_blocks->end(), all_map_blocks.begin(),
+                          all_map_blocks.end());
+  }
+
   return true;
 }
 
@@ -99,8 +105,7 @@ void MOMeshIntegrator::generateMeshBlocksFunction(
     const BlockIndex &block_idx = all_map_blocks[list_idx];
     updateMeshForBlock(block_idx, &last_object_volume, &last_object_id);
     if (clear_updated_flag) {
-      typename Block<MOVoxel>::Ptr block =
-          map_->getMapLayerPtr()->getBlockPtrByIndex(block_idx);
+      Block<MOVoxel> *block = map_->getMapBlockPtrByIndex(block_idx);
       block->updated().reset(Update::kMesh);
     }
   }
@@ -201,7 +206,7 @@ void MOMeshIntegrator::extractMeshInsideBlock(
   CHECK(next_mesh_index != nullptr);
   CHECK(mesh != nullptr);
 
-  Block<TsdfVoxel>::Ptr last_tsdf_block = nullptr;
+  Block<TsdfVoxel> *last_tsdf_block = nullptr;
   BlockIndex last_tsdf_block_idx;
 
   Eigen::Matrix<FloatingPoint, 3, 8> cube_coord_offsets =
@@ -215,7 +220,7 @@ void MOMeshIntegrator::extractMeshInsideBlock(
     const MOVoxel &voxel = block.getVoxelByVoxelIndex(corner_index);
 
     // Get the id of the object currently active at this voxel.
-    ObjectID object_id = voxel.active_object.object_id;
+    ObjectID object_id = voxel.active_object().object_id;
 
     if (object_id == EmptyID) {
       all_neighbors_observed = false;
@@ -241,6 +246,15 @@ void MOMeshIntegrator::extractMeshInsideBlock(
     }
 
     corner_coords.col(i) = coords + cube_coord_offsets.col(i);
+
+    // Voxels of coarser objects are interpolated at the map voxel center.
+    if ((*last_object_volume)->getVoxelScaleShift() > 0u &&
+        !(*last_object_volume)
+             ->getInterpolatedDistance(corner_coords.col(i),
+                                       config_.min_weight, &(corner_sdf(i)))) {
+      all_neighbors_observed = false;
+      break;
+    }
   }
 
   if (all_neighbors_observed) {
@@ -255,7 +269,7 @@ void MOMeshIntegrator::extractMeshOnBorder(
     VertexIndex *next_mesh_index, Mesh *mesh) {
   CHECK(mesh != nullptr);
 
-  Block<TsdfVoxel>::Ptr last_tsdf_block = nullptr;
+  Block<TsdfVoxel> *last_tsdf_block = nullptr;
   BlockIndex last_tsdf_block_idx;
 
   Eigen::Matrix<FloatingPoint, 3, 8> cube_coord_offsets =
@@ -272,7 +286,7 @@ void MOMeshIntegrator::extractMeshOnBorder(
     if (block.isValidVoxelIndex(corner_index)) {
       const MOVoxel &voxel = block.getVoxelByVoxelIndex(corner_index);
       // Get the id of the object currently active at this voxel.
-      ObjectID object_id = voxel.active_object.object_id;
+      ObjectID object_id = voxel.active_object().object_id;
 
       if (object_id == EmptyID) {
         all_neighbors_observed = false;
@@ -299,6 +313,16 @@ void MOMeshIntegrator::extractMeshOnBorder(
       }
 
       corner_coords.col(i) = coords + cube_coord_offsets.col(i);
+
+      // Voxels of coarser objects are interpolated at the map voxel center.
+      if ((*last_object_volume)->getVoxelScaleShift() > 0u &&
+          !(*last_object_volume)
+               ->getInterpolatedDistance(corner_coords.col(i),
+                                         config_.min_weight,
+                                         &(corner_sdf(i)))) {
+        all_neighbors_observed = false;
+        break;
+      }
     } else {
       // We have to access a different block.
       BlockIndex block_offset = BlockIndex::Zero();
@@ -316,15 +340,17 @@ void MOMeshIntegrator::extractMeshOnBorder(
 
       BlockIndex neighbor_index = block.block_index() + block_offset;
 
-      if (map_->getMapLayerPtr()->hasBlock(neighbor_index)) {
-        const Block<MOVoxel> &neighbor_block =
-            map_->getMapLayerPtr()->getBlockByIndex(neighbor_index);
+      const Block<MOVoxel> *neighbor_block_ptr =
+          map_->getMapBlockPtrByIndex(neighbor_index);
+
+      if (neighbor_block_ptr != nullptr) {
+        const Block<MOVoxel> &neighbor_block = *neighbor_block_ptr;
 
         CHECK(neighbor_block.isValidVoxelIndex(corner_index));
         const MOVoxel &voxel =
             neighbor_block.getVoxelByVoxelIndex(corner_index);
         // Get the id of the object currently active at this voxel.
-        ObjectID object_id = voxel.active_object.object_id;
+        ObjectID object_id = voxel.active_object().object_id;
 
         if (object_id == EmptyID) {
           all_neighbors_observed = false;
@@ -350,6 +376,16 @@ void MOMeshIntegrator::extractMeshOnBorder(
         }
 
         corner_coords.col(i) = coords + cube_coord_offsets.col(i);
+
+        // Voxels of coarser objects are interpolated at the map voxel center.
+        if ((*last_object_volume)->getVoxelScaleShift() > 0u &&
+            !(*last_object_volume)
+                 ->getInterpolatedDistance(corner_coords.col(i),
+                                           config_.min_weight,
+                                           &(corner_sdf(i)))) {
+          all_neighbors_observed = false;
+          break;
+        }
       } else {
         all_neighbors_observed = false;
         break;
@@ -375,7 +411,7 @@ void MOMeshIntegrator::updateMeshColor(const Block<MOVoxel> &block,
     VoxelIndex voxel_index = block.computeVoxelIndexFromCoordinates(vertex);
     if (block.isValidVoxelIndex(voxel_index)) {
       const MOVoxel &voxel = block.getVoxelByVoxelIndex(voxel_index);
-      ObjectID object_id = voxel.active_object.object_id;
+      ObjectID object_id = voxel.active_object().object_id;
       ObjectVolume *object_volume = map_->getObjectVolumePtrById(object_id);
       if (config_.using_ground_truth_segmentation) {
         if (object_id != 0u) {
@@ -391,10 +427,10 @@ void MOMeshIntegrator::updateMeshColor(const Block<MOVoxel> &block,
         }
       }
     } else {
-      const typename Block<MOVoxel>::ConstPtr neighbor_block =
-          map_->getMapLayerPtr()->getBlockPtrByCoordinates(vertex);
+      const Block<MOVoxel> *neighbor_block = map_->getMapBlockPtrByIndex(
+          getGridIndexFromPoint<BlockIndex>(vertex, block_size_inv_));
       const MOVoxel &voxel = neighbor_block->getVoxelByCoordinates(vertex);
-      ObjectID object_id = voxel.active_object.object_id;
+      ObjectID object_id = voxel.active_object().object_id;
       ObjectVolume *object_volume = map_->getObjectVolumePtrById(object_id);
       if (config_.using_ground_truth_segmentation) {
         if (object_id != 0u) {
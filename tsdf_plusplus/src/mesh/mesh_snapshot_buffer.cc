@@ -0,0 +1,55 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include "tsdf_plusplus/mesh/mesh_snapshot_buffer.h"
+
+#include <glog/logging.h>
+
+void MeshSnapshotBuffer::publishBlocks(const MeshLayer &mesh_layer,
+                                       const BlockIndexList &block_indices) {
+  // Copy the meshes before taking the lock.
+  MeshSnapshotMap snapshots;
+  for (const BlockIndex &block_index : block_indices) {
+    if (!mesh_layer.hasMesh(block_index)) {
+      snapshots[block_index] = nullptr;
+      continue;
+    }
+
+    Mesh::ConstPtr mesh = mesh_layer.getMeshPtrByIndex(block_index);
+    snapshots[block_index] = std::make_shared<const Mesh>(*mesh);
+  }
+
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  for (auto &pair : snapshots) {
+    pending_snapshots_[pair.first] = std::move(pair.second);
+  }
+}
+
+void MeshSnapshotBuffer::publishRemovedBlocks(
+    const BlockIndexList &block_indices) {
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  for (const BlockIndex &block_index : block_indices) {
+    pending_snapshots_[block_index] = nullptr;
+  }
+}
+
+void MeshSnapshotBuffer::publishClear() {
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  pending_snapshots_.clear();
+  pending_clear_ = true;
+}
+
+bool MeshSnapshotBuffer::takeSnapshots(MeshSnapshotMap *snapshots,
+                                       bool *cleared) {
+  CHECK_NOTNULL(snapshots);
+  CHECK_NOTNULL(cleared);
+
+  snapshots->clear();
+
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  snapshots->swap(pending_snapshots_);
+  *cleared = pending_clear_;
+  pending_clear_ = false;
+
+  return *cleared || !snapshots->empty();
+}
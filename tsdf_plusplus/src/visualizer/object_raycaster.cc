@@ -0,0 +1,213 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include "tsdf_plusplus/visualizer/object_raycaster.h"
+
+#include <cmath>
+#include <functional>
+#include <list>
+
+#include <voxblox/integrator/integrator_utils.h>
+
+ObjectRaycaster::ObjectRaycaster(const Config &config, std::shared_ptr<Map> map)
+    : config_(config), map_(map),
+      voxel_indexer_(map->getMapLayerPtr()->voxels_per_side()) {
+  CHECK(map_);
+
+  const Layer<MOVoxel> *map_layer = map_->getMapLayerPtr();
+  voxel_size_ = map_layer->voxel_size();
+  voxel_size_inv_ = 1.0 / voxel_size_;
+  block_size_ = map_layer->block_size();
+
+  if (config_.render_threads == 0) {
+    LOG(WARNING) << "Automatic core count failed, defaulting to 1 threads";
+    config_.render_threads = 1;
+  }
+}
+
+void ObjectRaycaster::takeSnapshot(const Transformation &T_G_C,
+                                   Snapshot *snapshot) {
+  CHECK_NOTNULL(snapshot);
+
+  snapshot->T_G_C = T_G_C;
+  snapshot->block_object_ids.clear();
+
+  const Transformation T_C_G = T_G_C.inverse();
+  const size_t num_voxels_per_block = voxel_indexer_.voxels_per_side() *
+                                      voxel_indexer_.voxels_per_side() *
+                                      voxel_indexer_.voxels_per_side();
+
+  BlockIndexList block_indices;
+  map_->getMapLayerPtr()->getAllAllocatedBlocks(&block_indices);
+
+  std::vector<ObjectID> object_ids;
+
+  for (const BlockIndex &block_idx : block_indices) {
+    if (!isBlockInFrustum(T_C_G, block_idx)) {
+      continue;
+    }
+
+    const Block<MOVoxel> *mo_block = map_->getMapBlockPtrByIndex(block_idx);
+    CHECK_NOTNULL(mo_block);
+
+    ObjectID last_object_id;
+    ObjectVolume *last_object_volume = nullptr;
+    Block<TsdfVoxel> *tsdf_block = nullptr;
+    BlockIndex last_tsdf_block_idx;
+
+    object_ids.assign(num_voxels_per_block, EmptyID);
+    bool has_surface_voxel = false;
+
+    for (size_t linear_idx = 0u; linear_idx < num_voxels_per_block;
+         ++linear_idx) {
+      const ObjectID active_object_id =
+          mo_block->getVoxelByLinearIndex(linear_idx).active_object().object_id;
+
+      if (active_object_id == EmptyID) {
+        continue;
+      }
+
+      const GlobalIndex global_voxel_idx = voxel_indexer_.getGlobalVoxelIndex(
+          block_idx, voxel_indexer_.getVoxelIndexFromLinearIndex(linear_idx));
+
+      const TsdfVoxel *tsdf_voxel = map_->getAllocatedTsdfVoxelPtr(
+          active_object_id, global_voxel_idx, &last_object_volume,
+          &last_object_id, &tsdf_block, &last_tsdf_block_idx);
+
+      // Observed voxels behind the surface.
+      if (tsdf_voxel != nullptr && tsdf_voxel->weight > config_.min_weight &&
+          tsdf_voxel->distance <= 0.0f) {
+        object_ids[linear_idx] = active_object_id;
+        has_surface_voxel = true;
+      }
+    }
+
+    if (has_surface_voxel) {
+      snapshot->block_object_ids[block_idx].swap(object_ids);
+    }
+  }
+}
+
+bool ObjectRaycaster::isBlockInFrustum(const Transformation &T_C_G,
+                                       const BlockIndex &block_idx) const {
+  const Point block_center_C =
+      T_C_G * (getOriginPointFromGridIndex(block_idx, block_size_) +
+               Point::Constant(0.5f * block_size_));
+  const FloatingPoint radius = 0.5f * std::sqrt(3.0f) * block_size_;
+
+  if (block_center_C.z() < -radius ||
+      block_center_C.z() > config_.max_depth + radius) {
+    return false;
+  }
+
+  // Side planes of the frustum through the camera center, given by the
+  // slopes of the rays through the outermost pixels.
+  const FloatingPoint min_slope_x = -config_.cx / config_.fx;
+  const FloatingPoint max_slope_x =
+      (static_cast<FloatingPoint>(config_.image_width) - 1.0f - config_.cx) /
+      config_.fx;
+  const FloatingPoint min_slope_y = -config_.cy / config_.fy;
+  const FloatingPoint max_slope_y =
+      (static_cast<FloatingPoint>(config_.image_height) - 1.0f - config_.cy) /
+      config_.fy;
+
+  const Point plane_normals[4] = {
+      Point(1.0f, 0.0f, -min_slope_x).normalized(),
+      Point(-1.0f, 0.0f, max_slope_x).normalized(),
+      Point(0.0f, 1.0f, -min_slope_y).normalized(),
+      Point(0.0f, -1.0f, max_slope_y).normalized()};
+
+  for (const Point &plane_normal : plane_normals) {
+    if (plane_normal.dot(block_center_C) < -radius) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void ObjectRaycaster::render(const Snapshot &snapshot,
+                             std::vector<ObjectID> *object_ids,
+                             std::vector<float> *depths) const {
+  CHECK_NOTNULL(object_ids);
+  CHECK_NOTNULL(depths);
+
+  const size_t num_pixels = config_.image_width * config_.image_height;
+  object_ids->assign(num_pixels, EmptyID);
+  depths->assign(num_pixels, 0.0f);
+
+  std::list<std::thread> render_threads;
+  for (size_t i = 0u; i < config_.render_threads; ++i) {
+    render_threads.emplace_back(&ObjectRaycaster::renderRows, this,
+                                std::cref(snapshot), i, object_ids, depths);
+  }
+
+  for (std::thread &thread : render_threads) {
+    thread.join();
+  }
+}
+
+void ObjectRaycaster::renderRows(const Snapshot &snapshot, size_t thread_idx,
+                                 std::vector<ObjectID> *object_ids,
+                                 std::vector<float> *depths) const {
+  const Transformation &T_G_C = snapshot.T_G_C;
+  const Point &origin = T_G_C.getPosition();
+  const Transformation T_C_G = T_G_C.inverse();
+
+  for (size_t v = thread_idx; v < config_.image_height;
+       v += config_.render_threads) {
+    for (size_t u = 0u; u < config_.image_width; ++u) {
+      // Ray through the pixel, scaled to reach max_depth along the z axis.
+      const Point ray_C((u - config_.cx) / config_.fx,
+                        (v - config_.cy) / config_.fy, 1.0f);
+      const Point ray_end = T_G_C * (ray_C * config_.max_depth);
+
+      ObjectID object_id;
+      Point hit_point_G;
+      if (castRay(snapshot, origin, ray_end, &object_id, &hit_point_G)) {
+        const size_t pixel_idx = v * config_.image_width + u;
+        (*object_ids)[pixel_idx] = object_id;
+        (*depths)[pixel_idx] = (T_C_G * hit_point_G).z();
+      }
+    }
+  }
+}
+
+bool ObjectRaycaster::castRay(const Snapshot &snapshot, const Point &origin,
+                              const Point &ray_end, ObjectID *object_id,
+                              Point *hit_point_G) const {
+  RayCaster ray_caster(origin * voxel_size_inv_, ray_end * voxel_size_inv_);
+
+  BlockIndex last_block_idx;
+  const std::vector<ObjectID> *block_object_ids = nullptr;
+  bool block_looked_up = false;
+
+  GlobalIndex global_voxel_idx;
+  while (ray_caster.nextRayIndex(&global_voxel_idx)) {
+    const BlockIndex block_idx = voxel_indexer_.getBlockIndex(global_voxel_idx);
+
+    if (!block_looked_up || block_idx != last_block_idx) {
+      const auto it = snapshot.block_object_ids.find(block_idx);
+      block_object_ids =
+          (it != snapshot.block_object_ids.end()) ? &it->second : nullptr;
+      last_block_idx = block_idx;
+      block_looked_up = true;
+    }
+
+    if (block_object_ids == nullptr) {
+      continue;
+    }
+
+    const ObjectID hit_object_id =
+        (*block_object_ids)[voxel_indexer_.getLinearIndex(global_voxel_idx)];
+
+    // The first voxel behind the surface.
+    if (hit_object_id != EmptyID) {
+      *object_id = hit_object_id;
+      *hit_point_G = getCenterPointFromGridIndex(global_voxel_idx, voxel_size_);
+      return true;
+    }
+  }
+
+  return false;
+}
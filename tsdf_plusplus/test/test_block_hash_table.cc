@@ -0,0 +1,183 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <voxblox/core/layer.h>
+#include <voxblox/core/voxel.h>
+
+#include "tsdf_plusplus/core/block_hash_table.h"
+
+class BlockHashTableTest : public ::testing::Test {
+protected:
+  // Small blocks, only their lookup matters.
+  static constexpr FloatingPoint kVoxelSize = 0.1f;
+  static constexpr size_t kVoxelsPerSide = 2u;
+
+  BlockHashTableTest() : layer_(kVoxelSize, kVoxelsPerSide) {}
+
+  // Allocates the blocks of a box around the origin, like the blocks
+  // observed from a sensor in a room, and indexes them in table_.
+  void allocateBox(int half_x, int half_y, int half_z) {
+    for (int x = -half_x; x < half_x; ++x) {
+      for (int y = -half_y; y < half_y; ++y) {
+        for (int z = -half_z; z < half_z; ++z) {
+          const BlockIndex block_idx(x, y, z);
+          table_.insert(block_idx,
+                        layer_.allocateNewBlock(block_idx).get());
+          block_indices_.push_back(block_idx);
+        }
+      }
+    }
+  }
+
+  Layer<TsdfVoxel> layer_;
+  BlockHashTable<TsdfVoxel> table_;
+  std::vector<BlockIndex> block_indices_;
+};
+
+TEST_F(BlockHashTableTest, InsertFind) {
+  EXPECT_TRUE(table_.empty());
+  allocateBox(8, 8, 4);
+  EXPECT_EQ(block_indices_.size(), table_.size());
+
+  for (const BlockIndex &block_idx : block_indices_) {
+    EXPECT_EQ(layer_.getBlockPtrByIndex(block_idx).get(),
+              table_.find(block_idx));
+  }
+  EXPECT_EQ(nullptr, table_.find(BlockIndex(100, 0, 0)));
+  EXPECT_EQ(nullptr, table_.find(BlockIndex(-9, 0, 0)));
+}
+
+TEST_F(BlockHashTableTest, InsertReplaces) {
+  allocateBox(2, 2, 2);
+  const BlockIndex block_idx = block_indices_.front();
+  Block<TsdfVoxel> *other_block = table_.find(block_indices_.back());
+
+  table_.insert(block_idx, other_block);
+  EXPECT_EQ(block_indices_.size(), table_.size());
+  EXPECT_EQ(other_block, table_.find(block_idx));
+}
+
+TEST_F(BlockHashTableTest, Erase) {
+  allocateBox(8, 8, 4);
+
+  // Erase every third block in random order, the backward shifts must keep
+  // the remaining entries reachable from their home slots.
+  std::vector<BlockIndex> erased_indices;
+  for (size_t i = 0u; i < block_indices_.size(); i += 3u) {
+    erased_indices.push_back(block_indices_[i]);
+  }
+  std::mt19937 random_engine(0u);
+  std::shuffle(erased_indices.begin(), erased_indices.end(), random_engine);
+
+  for (const BlockIndex &block_idx : erased_indices) {
+    EXPECT_TRUE(table_.erase(block_idx));
+    EXPECT_FALSE(table_.erase(block_idx));
+  }
+  EXPECT_EQ(block_indices_.size() - erased_indices.size(), table_.size());
+
+  for (size_t i = 0u; i < block_indices_.size(); ++i) {
+    const BlockIndex &block_idx = block_indices_[i];
+    if (i % 3u == 0u) {
+      EXPECT_EQ(nullptr, table_.find(block_idx));
+    } else {
+      EXPECT_EQ(layer_.getBlockPtrByIndex(block_idx).get(),
+                table_.find(block_idx));
+    }
+  }
+
+  // Erased keys can be inserted again.
+  for (const BlockIndex &block_idx : erased_indices) {
+    table_.insert(block_idx, layer_.getBlockPtrByIndex(block_idx).get());
+  }
+  EXPECT_EQ(block_indices_.size(), table_.size());
+  for (const BlockIndex &block_idx : block_indices_) {
+    EXPECT_EQ(layer_.getBlockPtrByIndex(block_idx).get(),
+              table_.find(block_idx));
+  }
+
+  table_.clear();
+  EXPECT_TRUE(table_.empty());
+  EXPECT_EQ(nullptr, table_.find(block_indices_.front()));
+}
+
+// Times lookups of the table against the layer's own BlockHashMap. The
+// timings are only logged, they depend too much on the machine to be tested.
+TEST_F(BlockHashTableTest, LookupBenchmark) {
+  allocateBox(16, 16, 8);
+
+  // Queries in random order, half of them for blocks that are not allocated.
+  std::vector<BlockIndex> queries = block_indices_;
+  for (const BlockIndex &block_idx : block_indices_) {
+    queries.push_back(block_idx + BlockIndex(0, 0, 64));
+  }
+  std::mt19937 random_engine(0u);
+  std::shuffle(queries.begin(), queries.end(), random_engine);
+
+  constexpr size_t kNumRounds = 20u;
+  typedef std::chrono::steady_clock Clock;
+
+  size_t num_found_layer = 0u;
+  const Clock::time_point layer_start = Clock::now();
+  for (size_t round = 0u; round < kNumRounds; ++round) {
+    for (const BlockIndex &block_idx : queries) {
+      num_found_layer += layer_.getBlockPtrByIndex(block_idx) ? 1u : 0u;
+    }
+  }
+  const Clock::duration layer_duration = Clock::now() - layer_start;
+
+  size_t num_found_table = 0u;
+  const Clock::time_point table_start = Clock::now();
+  for (size_t round = 0u; round < kNumRounds; ++round) {
+    for (const BlockIndex &block_idx : queries) {
+      num_found_table += (table_.find(block_idx) != nullptr) ? 1u : 0u;
+    }
+  }
+  const Clock::duration table_duration = Clock::now() - table_start;
+
+  EXPECT_EQ(kNumRounds * block_indices_.size(), num_found_layer);
+  EXPECT_EQ(num_found_layer, num_found_table);
+
+  const double num_lookups = static_cast<double>(kNumRounds * queries.size());
+  LOG(INFO) << "Layer::getBlockPtrByIndex: "
+            << std::chrono::duration<double, std::nano>(layer_duration)
+                       .count() /
+                   num_lookups
+            << " ns per lookup.";
+  LOG(INFO) << "BlockHashTable::find: "
+            << std::chrono::duration<double, std::nano>(table_duration)
+                       .count() /
+                   num_lookups
+            << " ns per lookup.";
+
+  // Insertion and erasure, e.g. when blocks are allocated during
+  // integration and pruned when objects are removed.
+  const Clock::time_point update_start = Clock::now();
+  for (const BlockIndex &block_idx : block_indices_) {
+    table_.erase(block_idx);
+  }
+  for (const BlockIndex &block_idx : block_indices_) {
+    table_.insert(block_idx, layer_.getBlockPtrByIndex(block_idx).get());
+  }
+  const Clock::duration update_duration = Clock::now() - update_start;
+  EXPECT_EQ(block_indices_.size(), table_.size());
+
+  LOG(INFO) << "BlockHashTable::erase + insert: "
+            << std::chrono::duration<double, std::nano>(update_duration)
+                       .count() /
+                   block_indices_.size()
+            << " ns per block.";
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InitGoogleLogging(argv[0]);
+
+  return RUN_ALL_TESTS();
+}
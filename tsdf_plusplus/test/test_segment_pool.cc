@@ -0,0 +1,244 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "tsdf_plusplus/core/map.h"
+#include "tsdf_plusplus/core/segment.h"
+#include "tsdf_plusplus/integrator/integrator.h"
+
+namespace {
+std::atomic<size_t> num_allocations(0u);
+} // namespace
+
+// Count the allocations going through the global operator new, e.g. of the
+// std::vectors of the pool.
+void *operator new(std::size_t size) {
+  ++num_allocations;
+  if (void *ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t /*size*/) noexcept {
+  std::free(ptr);
+}
+
+class SegmentPoolTest : public ::testing::Test {
+protected:
+  static constexpr size_t kNumLabeledSegments = 8u;
+  static constexpr size_t kNumPoints = 1000u;
+
+  virtual void SetUp() {
+    cloud_.resize(kNumPoints);
+    for (size_t i = 0u; i < kNumPoints; ++i) {
+      InputPointType &point = cloud_.points[i];
+      point.x = 0.01f * i;
+      point.y = 0.0f;
+      point.z = 1.0f;
+      point.r = point.g = point.b = 128u;
+      point.semantic_class = BackgroundClass;
+    }
+
+    frame_segments_.reserve(kNumLabeledSegments + 1u);
+  }
+
+  // Acquires and fills the segments of a frame, the way the controller does
+  // for both the segmented images and the segmented pointclouds.
+  void processFrame() {
+    pool_.releaseAll();
+    frame_segments_.clear();
+
+    for (size_t label = 1u; label <= kNumLabeledSegments; ++label) {
+      Segment *segment = pool_.acquire(T_G_C_, static_cast<ObjectID>(label),
+                                       BackgroundClass);
+      for (size_t i = 0u; i < kNumPoints; ++i) {
+        segment->points_C_.emplace_back(0.01f * i, 0.01f * label, 1.0f);
+        segment->colors_.emplace_back(128u, 128u, 128u);
+      }
+      segment->computeCentroid();
+      frame_segments_.push_back(segment);
+    }
+
+    Segment *segment = pool_.acquire(cloud_, T_G_C_);
+    frame_segments_.push_back(segment);
+
+    // Segments assigned the same object are merged.
+    frame_segments_.front()->merge(*segment);
+  }
+
+  // Identity.
+  voxblox::Transformation T_G_C_;
+  pcl::PointCloud<InputPointType> cloud_;
+
+  SegmentPool pool_;
+  std::vector<Segment *> frame_segments_;
+};
+
+TEST_F(SegmentPoolTest, ReusesSegments) {
+  processFrame();
+  const std::vector<Segment *> first_frame_segments = frame_segments_;
+
+  processFrame();
+  EXPECT_EQ(first_frame_segments, frame_segments_);
+
+  for (size_t label = 1u; label <= kNumLabeledSegments; ++label) {
+    const Segment &segment = *frame_segments_[label - 1u];
+    EXPECT_EQ(label, segment.object_id_);
+    // The first segment holds the merged pointcloud segment as well.
+    EXPECT_EQ(label == 1u ? 2u * kNumPoints : kNumPoints,
+              segment.points_C_.size());
+  }
+  EXPECT_EQ(kNumPoints, frame_segments_.back()->points_C_.size());
+}
+
+TEST_F(SegmentPoolTest, WarmFramesDoNotAllocate) {
+  // Grow the buffers to the size of a frame.
+  constexpr size_t kNumWarmUpFrames = 2u;
+  for (size_t i = 0u; i < kNumWarmUpFrames; ++i) {
+    processFrame();
+  }
+
+  // The point buffers are Eigen aligned and do not go through operator new,
+  // they are checked to keep their storage instead.
+  std::vector<const voxblox::Point *> points_data;
+  for (const Segment *segment : frame_segments_) {
+    points_data.push_back(segment->points_C_.data());
+  }
+
+  const size_t num_allocations_before = num_allocations.load();
+
+  constexpr size_t kNumFrames = 10u;
+  for (size_t i = 0u; i < kNumFrames; ++i) {
+    processFrame();
+  }
+
+  EXPECT_EQ(num_allocations_before, num_allocations.load());
+  ASSERT_EQ(points_data.size(), frame_segments_.size());
+  for (size_t i = 0u; i < frame_segments_.size(); ++i) {
+    EXPECT_EQ(points_data[i], frame_segments_[i]->points_C_.data());
+  }
+}
+
+// Matches, assigns and integrates the segments of a frame, the way the
+// controller does.
+class FrameIntegrationTest : public ::testing::Test {
+protected:
+  static constexpr size_t kNumSmallSegments = 6u;
+  static constexpr size_t kSmallSegmentSide = 20u;
+  static constexpr size_t kLargeSegmentSide = 40u;
+  static constexpr size_t kNumClearingPoints = 100u;
+  static constexpr float kPointSpacing = 0.02f;
+
+  virtual void SetUp() {
+    Map::Config map_config;
+    map_config.voxel_size = 0.05f;
+    map_ = std::make_shared<Map>(map_config);
+
+    Integrator::Config integrator_config;
+    integrator_config.integrator_threads = 4u;
+    // The large segment spreads its rays over all threads, the small
+    // ones are integrated concurrently.
+    integrator_config.large_segment_min_points = 1000u;
+    integrator_config.enable_anti_grazing = true;
+    integrator_ = std::unique_ptr<Integrator>(
+        new Integrator(integrator_config, map_));
+
+    frame_segments_.reserve(kNumSmallSegments + 1u);
+  }
+
+  // Adds a square patch of points facing the camera.
+  static void addPatch(float x, size_t side, float depth, Segment *segment) {
+    for (size_t i = 0u; i < side; ++i) {
+      for (size_t j = 0u; j < side; ++j) {
+        segment->points_C_.emplace_back(x + kPointSpacing * i,
+                                        kPointSpacing * j, depth);
+        segment->colors_.emplace_back(128u, 128u, 128u);
+      }
+    }
+  }
+
+  void integrateFrame() {
+    pool_.releaseAll();
+    frame_segments_.clear();
+
+    // Segments lie apart from each other such that each keeps matching the
+    // object it created in the first frame.
+    for (size_t k = 0u; k < kNumSmallSegments; ++k) {
+      constexpr SemanticClass kSemanticClass = 1u;
+      Segment *segment = pool_.acquire(T_G_C_, EmptyID, kSemanticClass);
+      addPatch(static_cast<float>(k), kSmallSegmentSide, 2.0f, segment);
+      segment->computeCentroid();
+      frame_segments_.push_back(segment);
+    }
+
+    // Large background segment, with points beyond max_ray_length_m cast as
+    // clearing rays.
+    Segment *segment = pool_.acquire(T_G_C_, EmptyID, BackgroundClass);
+    addPatch(-2.0f, kLargeSegmentSide, 2.0f, segment);
+    for (size_t i = 0u; i < kNumClearingPoints; ++i) {
+      segment->points_C_.emplace_back(-0.5f - kPointSpacing * i, 0.0f, 8.0f);
+      segment->colors_.emplace_back(128u, 128u, 128u);
+    }
+    segment->computeCentroid();
+    frame_segments_.push_back(segment);
+
+    segment_overlaps_.clear();
+    for (Segment *frame_segment : frame_segments_) {
+      integrator_->computeObjectOverlap(frame_segment, &segment_overlaps_);
+    }
+
+    merged_segments_.clear();
+    integrator_->assignObjectIds(&frame_segments_, &segment_overlaps_,
+                                 &merged_segments_);
+
+    integrator_->integrateSegments(merged_segments_);
+  }
+
+  // Identity.
+  voxblox::Transformation T_G_C_;
+
+  std::shared_ptr<Map> map_;
+  std::unique_ptr<Integrator> integrator_;
+
+  SegmentPool pool_;
+  std::vector<Segment *> frame_segments_;
+  SegmentOverlapList segment_overlaps_;
+  std::vector<Segment *> merged_segments_;
+};
+
+TEST_F(FrameIntegrationTest, WarmFramesDoNotAllocate) {
+  // The first frame allocates the objects and their blocks, the following
+  // ones grow the buffers of the integrator.
+  constexpr size_t kNumWarmUpFrames = 3u;
+  for (size_t i = 0u; i < kNumWarmUpFrames; ++i) {
+    integrateFrame();
+  }
+  ASSERT_EQ(kNumSmallSegments + 1u, merged_segments_.size());
+
+  const size_t num_allocations_before = num_allocations.load();
+
+  constexpr size_t kNumFrames = 10u;
+  for (size_t i = 0u; i < kNumFrames; ++i) {
+    integrateFrame();
+  }
+
+  EXPECT_EQ(num_allocations_before, num_allocations.load());
+  EXPECT_EQ(kNumSmallSegments + 1u, merged_segments_.size());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InitGoogleLogging(argv[0]);
+
+  return RUN_ALL_TESTS();
+}
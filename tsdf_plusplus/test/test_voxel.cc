@@ -0,0 +1,198 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "tsdf_plusplus/core/voxel.h"
+
+template <typename VoxelType>
+class MultiObjectVoxelTest : public ::testing::Test {
+protected:
+  static constexpr size_t kNumSlots = sizeof(VoxelType) / sizeof(Object);
+
+  // Observes object_id count times.
+  void observe(const ObjectID object_id, size_t count) {
+    for (size_t i = 0u; i < count; ++i) {
+      voxel_.observeObject(object_id);
+    }
+  }
+
+  void expectSlot(size_t slot_idx, const ObjectID object_id,
+                  const Confidence confidence) {
+    EXPECT_EQ(object_id, voxel_.objects[slot_idx].object_id)
+        << "at slot " << slot_idx;
+    EXPECT_EQ(confidence, voxel_.objects[slot_idx].confidence)
+        << "at slot " << slot_idx;
+  }
+
+  VoxelType voxel_;
+};
+
+typedef ::testing::Types<MultiObjectVoxel<2u>, MultiObjectVoxel<3u>,
+                         MultiObjectVoxel<4u>>
+    VoxelTypes;
+TYPED_TEST_CASE(MultiObjectVoxelTest, VoxelTypes);
+
+TYPED_TEST(MultiObjectVoxelTest, Size) {
+  EXPECT_EQ(this->kNumSlots * 4u, sizeof(TypeParam));
+}
+
+TYPED_TEST(MultiObjectVoxelTest, Empty) {
+  EXPECT_TRUE(this->voxel_.isEmpty());
+  EXPECT_EQ(EmptyID, this->voxel_.active_object().object_id);
+  EXPECT_EQ(0u, this->voxel_.free_confidence());
+}
+
+TYPED_TEST(MultiObjectVoxelTest, Ranking) {
+  this->observe(2u, 1u);
+  this->observe(3u, 1u);
+  // Ties do not overtake.
+  this->expectSlot(0u, 2u, 1u);
+  this->expectSlot(1u, 3u, 1u);
+
+  this->observe(3u, 1u);
+  this->expectSlot(0u, 3u, 2u);
+  this->expectSlot(1u, 2u, 1u);
+  EXPECT_FALSE(this->voxel_.isEmpty());
+}
+
+TYPED_TEST(MultiObjectVoxelTest, WearDown) {
+  // Fill all the slots, the last object being the least confident.
+  const size_t num_slots = this->kNumSlots;
+  for (size_t slot_idx = 0u; slot_idx < num_slots; ++slot_idx) {
+    this->observe(static_cast<ObjectID>(10u + slot_idx),
+                  num_slots + 1u - slot_idx);
+  }
+  const ObjectID last_object_id = static_cast<ObjectID>(10u + num_slots - 1u);
+  this->expectSlot(num_slots - 1u, last_object_id, 2u);
+
+  // An unseen object wears down the least confident one before replacing it.
+  this->observe(99u, 1u);
+  this->expectSlot(num_slots - 1u, last_object_id, 1u);
+  this->observe(99u, 1u);
+  this->expectSlot(num_slots - 1u, 99u, 1u);
+  this->expectSlot(0u, 10u, static_cast<Confidence>(num_slots + 1u));
+}
+
+TYPED_TEST(MultiObjectVoxelTest, FreeSpace) {
+  this->voxel_.observeFreeSpace();
+  this->voxel_.observeFreeSpace();
+  EXPECT_EQ(2u, this->voxel_.free_confidence());
+  EXPECT_FALSE(this->voxel_.isEmpty());
+
+  // An object observation resets the free confidence.
+  this->observe(2u, 3u);
+  this->observe(3u, 2u);
+  EXPECT_EQ(0u, this->voxel_.free_confidence());
+  this->expectSlot(0u, 2u, 3u);
+
+  // The active object loses confidence, ties keep the ranking.
+  this->voxel_.observeFreeSpace();
+  this->expectSlot(0u, 2u, 2u);
+  this->voxel_.observeFreeSpace();
+  this->expectSlot(0u, 3u, 2u);
+  this->expectSlot(1u, 2u, 1u);
+
+  // Objects are removed once their confidence reaches zero.
+  this->voxel_.observeFreeSpace();
+  this->voxel_.observeFreeSpace();
+  this->expectSlot(0u, 2u, 1u);
+  this->expectSlot(1u, EmptyID, 0u);
+  this->voxel_.observeFreeSpace();
+  EXPECT_TRUE(this->voxel_.isEmpty());
+
+  // From here on free space is accumulated again.
+  this->voxel_.observeFreeSpace();
+  EXPECT_EQ(1u, this->voxel_.free_confidence());
+}
+
+TYPED_TEST(MultiObjectVoxelTest, ActivateAndRemove) {
+  this->voxel_.observeFreeSpace();
+  this->observe(2u, 3u);
+  this->observe(3u, 2u);
+
+  this->voxel_.activateObject(3u, 1u);
+  this->expectSlot(0u, 3u, 1u);
+  this->expectSlot(1u, 2u, 3u);
+
+  this->voxel_.activateObject(4u, 5u);
+  this->expectSlot(0u, 4u, 5u);
+  this->expectSlot(1u, 3u, 1u);
+
+  this->voxel_.removeObject(4u);
+  this->expectSlot(0u, 3u, 1u);
+  this->expectSlot(this->kNumSlots - 1u, EmptyID, 0u);
+
+  // Removing an object the voxel does not hold changes nothing.
+  this->voxel_.removeObject(42u);
+  this->expectSlot(0u, 3u, 1u);
+
+  // Activating an empty voxel discards its free confidence.
+  TypeParam voxel;
+  voxel.observeFreeSpace();
+  voxel.activateObject(5u, 1u);
+  EXPECT_EQ(5u, voxel.active_object().object_id);
+  EXPECT_EQ(1u, voxel.active_object().confidence);
+  EXPECT_EQ(0u, voxel.free_confidence());
+}
+
+// Times the updates over a layer sized array of voxels, observed by a few
+// objects and free space at random. The timings are only logged, they depend
+// too much on the machine to be tested.
+TYPED_TEST(MultiObjectVoxelTest, UpdateBenchmark) {
+  constexpr size_t kNumVoxels = 1u << 20u;
+  constexpr size_t kNumUpdates = 1u << 22u;
+  constexpr ObjectID kNumObjects = 6u;
+
+  std::vector<TypeParam> voxels(kNumVoxels);
+
+  std::mt19937 random_engine(0u);
+  std::vector<uint32_t> voxel_indices(kNumUpdates);
+  std::vector<ObjectID> object_ids(kNumUpdates);
+  std::uniform_int_distribution<uint32_t> voxel_distribution(0u,
+                                                             kNumVoxels - 1u);
+  // EmptyID stands for an observation of free space.
+  std::uniform_int_distribution<ObjectID> object_distribution(EmptyID,
+                                                              kNumObjects);
+  for (size_t i = 0u; i < kNumUpdates; ++i) {
+    voxel_indices[i] = voxel_distribution(random_engine);
+    object_ids[i] = object_distribution(random_engine);
+  }
+
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point start = Clock::now();
+  for (size_t i = 0u; i < kNumUpdates; ++i) {
+    TypeParam &voxel = voxels[voxel_indices[i]];
+    if (object_ids[i] == EmptyID) {
+      voxel.observeFreeSpace();
+    } else {
+      voxel.observeObject(object_ids[i]);
+    }
+  }
+  const Clock::duration duration = Clock::now() - start;
+
+  size_t num_occupied = 0u;
+  for (const TypeParam &voxel : voxels) {
+    num_occupied += (voxel.active_object().object_id != EmptyID) ? 1u : 0u;
+  }
+  EXPECT_GT(num_occupied, 0u);
+
+  LOG(INFO) << this->kNumSlots << " slots: " << sizeof(TypeParam)
+            << " bytes per voxel, "
+            << std::chrono::duration<double, std::nano>(duration).count() /
+                   kNumUpdates
+            << " ns per update, " << num_occupied << " of " << kNumVoxels
+            << " voxels occupied.";
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  google::InitGoogleLogging(argv[0]);
+
+  return RUN_ALL_TESTS();
+}
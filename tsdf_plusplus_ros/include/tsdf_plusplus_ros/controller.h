@@ -4,6 +4,9 @@
 #ifndef TSDF_PLUSPLUS_ROS_CONTROLLER_H_
 #define TSDF_PLUSPLUS_ROS_CONTROLLER_H_
 
+#include <chrono>
+#include <shared_mutex>
+
 #include <message_filters/subscriber.h>
 #include <ros/ros.h>
 #include <std_msgs/Bool.h>
@@ -13,12 +16,18 @@
 #include <tsdf_plusplus/core/segment.h>
 #include <tsdf_plusplus/integrator/integrator.h>
 #include <tsdf_plusplus/mesh/mesh_integrator.h>
+#include <tsdf_plusplus/mesh/mesh_snapshot_buffer.h>
 #include <tsdf_plusplus/visualizer/visualizer.h>
 #include <tsdf_plusplus_msgs/Reward.h>
+#include <tsdf_plusplus_msgs/SegmentedFrame.h>
 #include <tsdf_plusplus_msgs/SegmentedPointCloud.h>
 #include <voxblox/core/common.h>
 #include <voxblox/utils/timing.h>
 
+#include "tsdf_plusplus_ros/frame_exporter.h"
+#include "tsdf_plusplus_ros/mesh_publisher.h"
+#include "tsdf_plusplus_ros/shm_observation_writer.h"
+
 class Controller {
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -36,13 +45,23 @@ public:
   void getConfigFromRosParam(const ros::NodeHandle &nh_private);
 
 protected:
+  // The caller must hold frame_mutex_, as for all the functions handling the
+  // segments of the current frame.
   void processSegmentPointcloud(
-      const tsdf_plusplus_msgs::SegmentedPointCloud::Ptr &segment_pcl_msg);
+      const tsdf_plusplus_msgs::SegmentedPointCloud::ConstPtr &segment_pcl_msg);
+
+  void processSegmentedFrame(
+      const tsdf_plusplus_msgs::SegmentedFrame::ConstPtr &segmented_frame_msg);
+
+  // Integrates the segments of the current frame, if any, and publishes the
+  // resulting map information. The caller must hold frame_mutex_.
+  void finishFrame();
 
   bool lookupTransformTF(const std::string &from_frame,
                          const std::string &to_frame,
                          const ros::Time &timestamp, Transformation *transform);
 
+  // The caller must hold frame_mutex_.
   void integrateFrame();
 
   void integrateSemanticClasses();
@@ -53,6 +72,7 @@ protected:
 
   void publishPointclouds();
 
+  // The caller must hold frame_mutex_.
   void clearFrame();
 
   void resetCallback(const std_msgs::Bool::Ptr &reset_msg);
@@ -60,7 +80,10 @@ protected:
   void updateMeshEvent(const ros::TimerEvent &event);
 
   void segmentPointcloudCallback(
-      const tsdf_plusplus_msgs::SegmentedPointCloud::Ptr &segment_pcl_msg);
+      const tsdf_plusplus_msgs::SegmentedPointCloud::ConstPtr &segment_pcl_msg);
+
+  void segmentedFrameCallback(
+      const tsdf_plusplus_msgs::SegmentedFrame::ConstPtr &segmented_frame_msg);
 
   bool generateMeshCallback(std_srvs::Empty::Request & /*request*/,
                             std_srvs::Empty::Response & /*response*/);
@@ -76,11 +99,39 @@ protected:
   bool publishReward();
   bool publishMap();
 
+  // Removes the object from the map and forgets its mesh color, appends the
+  // map blocks pruned by the removal to pruned_block_indices. Returns the
+  // number of bytes freed. The caller must hold map_mutex_ exclusively.
+  size_t removeObject(const ObjectID &object_id,
+                      BlockIndexList *pruned_block_indices);
+
+  // Deletes the meshes of the pruned map blocks and publishes their removal.
+  // The caller must hold mesh_layer_mutex_.
+  void removeMeshBlocks(const BlockIndexList &pruned_block_indices);
+
+  // Hands the meshes of meshed_blocks over to the mesh publisher, if any.
+  // The caller must hold mesh_layer_mutex_.
+  void publishMeshSnapshots(const BlockIndexList &meshed_blocks);
+
+  // Removes the spurious objects from the map.
+  void collectObjectsEvent(const ros::TimerEvent &event);
+
+  // Optional subsystems, created on first use.
+  ICP *getICP();
+  MOMeshIntegrator *getMeshIntegrator();
+
+  // Logs the time from startup to the first integrated frame.
+  void reportFirstIntegration();
+
   ros::NodeHandle nh_;
   ros::NodeHandle nh_private_;
 
+  std::chrono::steady_clock::time_point startup_time_;
+  bool first_integration_reported_;
+
   // Data subscribers.
   ros::Subscriber pointcloud_sub_;
+  ros::Subscriber segmented_frame_sub_;
   ros::Subscriber reset_sub_;
 
   // Will throttle to this message rate.
@@ -107,35 +158,51 @@ protected:
   // Flag whether ground truth or real-world per-frame segmentation is used.
   bool using_ground_truth_segmentation_;
 
-  // List of segments observed in the current frame.
+  // Whether the colors of the segments are parsed and integrated.
+  bool integrate_color_;
+
+  // Guards the state of the current frame, from its segments to the frame
+  // number, against the input and reset callbacks running concurrently, e.g.
+  // with a multi-threaded spinner. A whole frame is processed and integrated
+  // under it. Taken before all the other mutexes.
+  std::mutex frame_mutex_;
+
+  // List of segments observed in the current frame, acquired from
+  // segment_pool_ and released in clearFrame.
   std::vector<Segment *> current_frame_segments_;
+  SegmentPool segment_pool_;
+
+  // Reused to convert the pointclouds of the incoming segments.
+  pcl::PointCloud<InputPointType> segment_cloud_;
+  pcl::PointCloud<GTInputPointType> gt_segment_cloud_;
   std::vector<std::pair<bool, Eigen::Matrix4f>> current_frame_movements_;
 
   // Pairwise overlap (number of points) between segments
   // in the current frame and objects in the map.
-  std::map<ObjectID, SegmentHistogram> object_segment_overlap_;
+  SegmentOverlapList segment_overlaps_;
 
   // Segments assigned to the same object_id during the
-  // segmentation propagation step are merged together.
-  std::map<ObjectID, Segment *> object_merged_segments_;
+  // segmentation propagation step are merged together,
+  // one segment per object_id.
+  std::vector<Segment *> merged_segments_;
 
   // ICP.
   bool object_tracking_enabled_;
   bool ground_truth_tracking_;
+  ICP::Config icp_config_;
   std::shared_ptr<ICP> icp_;
 
   // Maps and integrators.
   std::shared_ptr<Map> map_;
   std::unique_ptr<Integrator> integrator_;
 
-  // Mutex to prevent reading from the map layer while it is being updated.
-  std::mutex map_mutex_;
-
-  // Semantic classes.
-  std::vector<std::string> semantic_classes_;
+  // Reader/writer mutex of the map. Integration, tracking and removal hold it
+  // exclusively, publishers, meshing and exports share it.
+  std::shared_timed_mutex map_mutex_;
 
   // Meshing.
   std::shared_ptr<voxblox::MeshLayer> mesh_layer_;
+  MOMeshIntegrator::Config mesh_config_;
   std::unique_ptr<MOMeshIntegrator> mesh_integrator_;
   ros::Timer update_mesh_timer_;
   bool publish_mesh_;
@@ -144,6 +211,14 @@ protected:
   std::shared_ptr<std::mutex> mesh_layer_mutex_;
   std::shared_ptr<bool> mesh_layer_updated_;
 
+  // Snapshots of the re-meshed blocks, handed over to mesh_publisher_
+  // without sharing mesh_layer_mutex_. Only allocated along with it, as
+  // nothing else takes the snapshots.
+  std::shared_ptr<MeshSnapshotBuffer> mesh_snapshot_buffer_;
+
+  // Builds and publishes mesh messages in the background, if publish_mesh_.
+  std::unique_ptr<MeshPublisher> mesh_publisher_;
+
   // The mesh is written to a file only if mesh_filename_ is non-empty.
   std::string mesh_filename_;
 
@@ -164,10 +239,24 @@ protected:
   ros::ServiceServer move_object_srv_;
   ros::ServiceServer remove_objects_srv_;
 
+  // Garbage collection of spurious objects.
+  ros::Timer object_gc_timer_;
+  double object_gc_timeout_s_;
+  size_t object_gc_min_observations_;
+  size_t object_gc_min_voxels_;
+
   // Publishers.
   ros::Publisher mesh_pub_;
   ros::Publisher reward_pub_;
   ros::Publisher map_pub_;
+
+  // If enabled, the rewards and object summaries of each step are also
+  // written to shared memory for local consumers.
+  std::unique_ptr<ShmObservationWriter> shm_observation_writer_;
+
+  // If enabled, replaces the visualizer screenshots with segmentation images
+  // rendered and written asynchronously.
+  std::unique_ptr<FrameExporter> frame_exporter_;
 };
 
 #endif // TSDF_PLUSPLUS_ROS_CONTROLLER_H_
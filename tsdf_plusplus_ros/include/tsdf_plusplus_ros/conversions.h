@@ -0,0 +1,94 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_ROS_CONVERSIONS_H_
+#define TSDF_PLUSPLUS_ROS_CONVERSIONS_H_
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+#include <pcl/conversions.h>
+#include <pcl/point_cloud.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/image_encodings.h>
+
+// Converts a PointCloud2 message into a PCL pointcloud without modifying or
+// copying the message, so that it can be used on the shared messages received
+// by a nodelet. Colors are always read as a packed float "rgb" field, whatever
+// datatype the publisher declared for it.
+// Returns false if the data of the message is too short for its declared
+// layout, or if a field does not fit within a point, in which case
+// pointcloud_pcl is left unchanged.
+template <typename PointT>
+bool convertPointcloudMsg(const sensor_msgs::PointCloud2 &pointcloud_msg,
+                          pcl::PointCloud<PointT> *pointcloud_pcl) {
+  CHECK_NOTNULL(pointcloud_pcl);
+
+  std::vector<pcl::PCLPointField> fields;
+  pcl_conversions::toPCL(pointcloud_msg.fields, fields);
+
+  for (pcl::PCLPointField &field : fields) {
+    if (field.name == std::string("rgb")) {
+      field.datatype = pcl::PCLPointField::FLOAT32;
+    }
+  }
+
+  pcl::MsgFieldMap field_map;
+  pcl::createMapping<PointT>(fields, field_map);
+
+  for (const pcl::detail::FieldMapping &mapping : field_map) {
+    if (mapping.serialized_offset + mapping.size > pointcloud_msg.point_step) {
+      return false;
+    }
+  }
+
+  const uint64_t width = pointcloud_msg.width;
+  const uint64_t height = pointcloud_msg.height;
+  if (height > 0u && width > 0u &&
+      (pointcloud_msg.row_step < width * pointcloud_msg.point_step ||
+       pointcloud_msg.data.size() < height * pointcloud_msg.row_step)) {
+    return false;
+  }
+
+  pcl_conversions::toPCL(pointcloud_msg.header, pointcloud_pcl->header);
+  pointcloud_pcl->width = pointcloud_msg.width;
+  pointcloud_pcl->height = pointcloud_msg.height;
+  pointcloud_pcl->is_dense = pointcloud_msg.is_dense;
+  pointcloud_pcl->points.resize(pointcloud_msg.width * pointcloud_msg.height);
+
+  uint8_t *point_data =
+      reinterpret_cast<uint8_t *>(pointcloud_pcl->points.data());
+
+  for (uint32_t row = 0u; row < pointcloud_msg.height; ++row) {
+    const uint8_t *row_data =
+        pointcloud_msg.data.data() + row * pointcloud_msg.row_step;
+
+    for (uint32_t col = 0u; col < pointcloud_msg.width; ++col) {
+      const uint8_t *msg_data = row_data + col * pointcloud_msg.point_step;
+
+      for (const pcl::detail::FieldMapping &mapping : field_map) {
+        std::memcpy(point_data + mapping.struct_offset,
+                    msg_data + mapping.serialized_offset, mapping.size);
+      }
+      point_data += sizeof(PointT);
+    }
+  }
+
+  return true;
+}
+
+// Whether the rows of the image, as declared by its width, step and encoding,
+// lie within its data. The encoding must be known.
+inline bool isImageLayoutValid(const sensor_msgs::Image &image) {
+  const uint64_t bytes_per_pixel =
+      sensor_msgs::image_encodings::numChannels(image.encoding) *
+      (sensor_msgs::image_encodings::bitDepth(image.encoding) / 8u);
+  return image.step >= image.width * bytes_per_pixel &&
+         image.data.size() >= uint64_t(image.height) * image.step;
+}
+
+#endif // TSDF_PLUSPLUS_ROS_CONVERSIONS_H_
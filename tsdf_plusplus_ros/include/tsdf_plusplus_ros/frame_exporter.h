@@ -0,0 +1,81 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_ROS_FRAME_EXPORTER_H_
+#define TSDF_PLUSPLUS_ROS_FRAME_EXPORTER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tsdf_plusplus/core/map.h>
+#include <tsdf_plusplus/visualizer/object_raycaster.h>
+
+// Exports projected segmentation images of the map asynchronously. Frames are
+// queued by the integration callback along with a snapshot of the map data
+// they show, rendered from the snapshot by a worker thread with the CPU
+// raycaster, and encoded and written to file in batches by a pool of writer
+// threads. The map is integrated further while the frames are rendered, and
+// a frame never shows integrations of later frames.
+class FrameExporter {
+public:
+  struct Config {
+    std::string export_path = "";
+    size_t writer_threads = 2u;
+    // Frames queued while the queue is full are dropped.
+    size_t max_queued_frames = 8u;
+  };
+
+  FrameExporter(const Config &config,
+                const ObjectRaycaster::Config &raycaster_config,
+                std::shared_ptr<Map> map);
+
+  // Exports all queued frames before returning.
+  ~FrameExporter();
+
+  // Snapshots the map seen from T_G_C and queues its export, returns once the
+  // snapshot is taken. The caller must hold the map mutex, shared or
+  // exclusive. Must not be called concurrently with itself.
+  void exportFrame(uint32_t frame_number, const Transformation &T_G_C);
+
+protected:
+  struct RenderJob {
+    uint32_t frame_number;
+    std::unique_ptr<ObjectRaycaster::Snapshot> snapshot;
+  };
+
+  struct WriteJob {
+    uint32_t frame_number;
+    std::vector<ObjectID> object_ids;
+    // Depth in millimeters.
+    std::vector<uint16_t> depths;
+  };
+
+  void renderLoop();
+
+  void writeLoop();
+
+  void writeFrame(const WriteJob &write_job);
+
+  Config config_;
+
+  ObjectRaycaster raycaster_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable render_condition_;
+  std::condition_variable write_condition_;
+  std::deque<RenderJob> render_queue_;
+  std::deque<std::unique_ptr<WriteJob>> write_queue_;
+  bool shutdown_;
+  // Set once the render thread has handed over its last frame.
+  bool render_done_;
+
+  std::thread render_thread_;
+  std::vector<std::thread> writer_threads_;
+};
+
+#endif // TSDF_PLUSPLUS_ROS_FRAME_EXPORTER_H_
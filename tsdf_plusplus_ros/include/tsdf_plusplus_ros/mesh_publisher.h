@@ -0,0 +1,59 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_ROS_MESH_PUBLISHER_H_
+#define TSDF_PLUSPLUS_ROS_MESH_PUBLISHER_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <ros/ros.h>
+#include <tsdf_plusplus/mesh/mesh_snapshot_buffer.h>
+#include <voxblox/mesh/mesh_layer.h>
+
+// Builds and publishes mesh messages in a background thread. The mesher hands
+// over snapshots of the re-meshed blocks through a MeshSnapshotBuffer, which
+// the thread applies to its own copy of the mesh before serializing the
+// changed blocks, so neither the map nor the mesh layer is locked while a
+// message is built.
+//
+// Snapshots of the same block published while the thread is busy replace each
+// other, so when serialization falls behind, stale block meshes are dropped
+// and only the latest mesh of each block is sent.
+class MeshPublisher {
+public:
+  // The publisher is the consumer of snapshot_buffer.
+  MeshPublisher(const ros::Publisher &mesh_pub, const std::string &world_frame,
+                FloatingPoint block_size,
+                std::shared_ptr<MeshSnapshotBuffer> snapshot_buffer);
+
+  // Publishes the pending blocks before returning.
+  ~MeshPublisher();
+
+  // Wakes the publishing thread, to be called after publishing snapshots
+  // to the buffer.
+  void notify();
+
+protected:
+  void publishLoop();
+
+  ros::Publisher mesh_pub_;
+  std::string world_frame_;
+
+  std::shared_ptr<MeshSnapshotBuffer> snapshot_buffer_;
+
+  // Only accessed by the publishing thread.
+  MeshLayer mesh_layer_;
+
+  std::mutex pending_mutex_;
+  std::condition_variable pending_condition_;
+  bool pending_;
+  bool shutdown_;
+
+  std::thread publish_thread_;
+};
+
+#endif // TSDF_PLUSPLUS_ROS_MESH_PUBLISHER_H_
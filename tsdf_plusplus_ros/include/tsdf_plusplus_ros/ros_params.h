@@ -25,6 +25,37 @@ inline Map::Config getMapConfigFromRosParam(const ros::NodeHandle& nh_private) {
   map_config.voxel_size = static_cast<float>(voxel_size);
   map_config.voxels_per_side = voxels_per_side;
 
+  int background_voxel_scale_shift =
+      static_cast<int>(map_config.background_voxel_scale_shift);
+  int large_object_voxel_scale_shift =
+      static_cast<int>(map_config.large_object_voxel_scale_shift);
+  double large_object_min_extent = map_config.large_object_min_extent;
+  nh_private.param("object_resolution/background_voxel_scale_shift",
+                   background_voxel_scale_shift, background_voxel_scale_shift);
+  nh_private.param("object_resolution/large_object_voxel_scale_shift",
+                   large_object_voxel_scale_shift,
+                   large_object_voxel_scale_shift);
+  nh_private.param("object_resolution/large_object_min_extent",
+                   large_object_min_extent, large_object_min_extent);
+
+  if (background_voxel_scale_shift < 0 || background_voxel_scale_shift > 4) {
+    ROS_ERROR("background_voxel_scale_shift must be between 0 and 4, setting "
+              "to default value.");
+  } else {
+    map_config.background_voxel_scale_shift =
+        static_cast<unsigned int>(background_voxel_scale_shift);
+  }
+  if (large_object_voxel_scale_shift < 0 ||
+      large_object_voxel_scale_shift > 4) {
+    ROS_ERROR("large_object_voxel_scale_shift must be between 0 and 4, "
+              "setting to default value.");
+  } else {
+    map_config.large_object_voxel_scale_shift =
+        static_cast<unsigned int>(large_object_voxel_scale_shift);
+  }
+  map_config.large_object_min_extent =
+      static_cast<float>(large_object_min_extent);
+
   return map_config;
 }
 
@@ -50,10 +81,21 @@ inline Integrator::Config getIntegratorConfigFromRosParam(
                    integrator_config.use_const_weight);
   nh_private.param("use_weight_dropoff", integrator_config.use_weight_dropoff,
                    integrator_config.use_weight_dropoff);
+  std::string sensor_model = integrator_config.sensor_model;
+  nh_private.param("sensor_model", sensor_model, sensor_model);
+  SensorModel::DepthModel depth_model;
+  if (!SensorModel::getDepthModelFromString(sensor_model, &depth_model)) {
+    ROS_ERROR("sensor_model must be one of inverse_square, constant, rgbd, "
+              "setting to default value.");
+  } else {
+    integrator_config.sensor_model = sensor_model;
+  }
   nh_private.param("allow_clear", integrator_config.allow_clear,
                    integrator_config.allow_clear);
   nh_private.param("anti_grazing", integrator_config.enable_anti_grazing,
                    integrator_config.enable_anti_grazing);
+  nh_private.param("integrate_color", integrator_config.integrate_color,
+                   integrator_config.integrate_color);
   nh_private.param("use_sparsity_compensation_factor",
                    integrator_config.use_sparsity_compensation_factor,
                    integrator_config.use_sparsity_compensation_factor);
@@ -63,6 +105,17 @@ inline Integrator::Config getIntegratorConfigFromRosParam(
   nh_private.param("integration_order_mode",
                    integrator_config.integration_order_mode,
                    integrator_config.integration_order_mode);
+  int large_segment_min_points =
+      static_cast<int>(integrator_config.large_segment_min_points);
+  nh_private.param("large_segment_min_points", large_segment_min_points,
+                   large_segment_min_points);
+  if (large_segment_min_points < 0) {
+    ROS_ERROR("large_segment_min_points must be non-negative, setting to "
+              "default value.");
+  } else {
+    integrator_config.large_segment_min_points =
+        static_cast<size_t>(large_segment_min_points);
+  }
 
   integrator_config.truncation_distance =
       static_cast<float>(truncation_distance_factor) * map_config.voxel_size;
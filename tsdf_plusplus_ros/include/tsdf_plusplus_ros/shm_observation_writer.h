@@ -0,0 +1,106 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#ifndef TSDF_PLUSPLUS_ROS_SHM_OBSERVATION_WRITER_H_
+#define TSDF_PLUSPLUS_ROS_SHM_OBSERVATION_WRITER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Layout of the shared memory segment, a header followed by num_slots slots
+// of slot_size bytes each. All fields are little-endian and naturally aligned
+// so that local consumers (e.g. Python through numpy) can map them directly.
+//
+// Observations are written round robin into the slots. Each slot is guarded
+// by a seqlock: its sequence is odd while the slot is being written. A reader
+// copies slot (write_index - 1) % num_slots and accepts the copy if the
+// sequence was even and unchanged before and after copying.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "Shared memory observations need lock-free 64-bit atomics.");
+
+constexpr uint32_t kShmObservationMagic = 0x54505053u;  // "TPPS"
+constexpr uint32_t kShmObservationVersion = 1u;
+
+struct ShmObservationHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_slots;
+  uint32_t slot_size;
+  uint32_t max_objects;
+  uint32_t padding;
+  // Number of observations written so far.
+  std::atomic<uint64_t> write_index;
+};
+
+struct ShmRewardCounters {
+  uint32_t number_of_objects;
+  uint32_t number_of_voxels;
+  uint32_t number_of_free_voxels;
+  uint32_t number_of_occupied_voxels;
+  uint32_t number_of_unknown_voxels;
+  uint32_t padding;
+};
+
+struct ShmObjectSummary {
+  uint32_t object_id;
+  uint32_t semantic_class;
+  uint32_t number_of_blocks;
+  // Translation of the object pose in world frame.
+  float position[3];
+};
+
+// Followed by max_objects ShmObjectSummary, of which num_objects are valid.
+struct ShmObservationSlot {
+  std::atomic<uint64_t> sequence;
+  uint64_t frame_number;
+  double stamp;
+  ShmRewardCounters reward;
+  uint32_t num_objects;
+  uint32_t padding;
+};
+
+// Publishes per-step map observations into a POSIX shared memory ring buffer.
+// The segment is created exclusively and only accessible to the user running
+// the writer, isOpen() is false if a segment of the same name exists.
+class ShmObservationWriter {
+public:
+  // Bounds of the segment layout.
+  static constexpr size_t kMaxNumSlots = 1024u;
+  static constexpr size_t kMaxObjects = 65536u;
+
+  ShmObservationWriter(const std::string &name, size_t num_slots,
+                       size_t max_objects);
+
+  // Unmaps and unlinks the shared memory segment.
+  ~ShmObservationWriter();
+
+  ShmObservationWriter(const ShmObservationWriter &) = delete;
+  ShmObservationWriter &operator=(const ShmObservationWriter &) = delete;
+
+  inline bool isOpen() const { return header_ != nullptr; }
+
+  // Writes an observation into the next slot, objects beyond max_objects
+  // are dropped. Thread safe.
+  void write(uint64_t frame_number, double stamp,
+             const ShmRewardCounters &reward,
+             const std::vector<ShmObjectSummary> &objects);
+
+protected:
+  ShmObservationSlot *getSlotPtr(uint64_t index);
+
+  std::string name_;
+  size_t num_slots_;
+  size_t max_objects_;
+  size_t slot_size_;
+  size_t size_;
+
+  ShmObservationHeader *header_;
+
+  // Serializes writers, the seqlock only protects readers.
+  std::mutex write_mutex_;
+};
+
+#endif // TSDF_PLUSPLUS_ROS_SHM_OBSERVATION_WRITER_H_
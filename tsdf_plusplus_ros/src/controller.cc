@@ -3,6 +3,8 @@
 
 #include "tsdf_plusplus_ros/controller.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <unordered_map>
@@ -10,6 +12,7 @@
 #include <minkindr_conversions/kindr_tf.h>
 #include <pcl/console/time.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/image_encodings.h>
 #include <tsdf_plusplus/alignment/icp_utils.h>
 #include <tsdf_plusplus/core/common.h>
 #include <tsdf_plusplus/core/map.h>
@@ -20,12 +23,14 @@
 #include <tsdf_plusplus_msgs/MovementPointCloud.h>
 #include <tsdf_plusplus_msgs/SegmentedPointCloud.h>
 #include <tsdf_plusplus_msgs/ObjectMapInformation.h>
+#include <tsdf_plusplus_msgs/SegmentedFrame.h>
 #include <voxblox/io/mesh_ply.h>
 #include <voxblox/io/sdf_ply.h>
 #include <voxblox_msgs/Mesh.h>
 #include <voxblox_ros/conversions.h>
 #include <voxblox_ros/mesh_vis.h>
 
+#include "tsdf_plusplus_ros/conversions.h"
 #include "tsdf_plusplus_ros/ros_params.h"
 
 Controller::Controller(const ros::NodeHandle &nh,
@@ -41,10 +46,16 @@ Controller::Controller(const ros::NodeHandle &nh,
                        const Integrator::Config &integrator_config,
                        const ICP::Config &icp_config,
                        const MOMeshIntegrator::Config &mesh_config)
-    : nh_(nh), nh_private_(nh_private), frame_number_(0u),
+    : nh_(nh), nh_private_(nh_private),
+      startup_time_(std::chrono::steady_clock::now()),
+      first_integration_reported_(false), frame_number_(0u),
       world_frame_("world"), sensor_frame_(""),
-      using_ground_truth_segmentation_(false), object_tracking_enabled_(false),
-      ground_truth_tracking_(false) {
+      using_ground_truth_segmentation_(false),
+      integrate_color_(integrator_config.integrate_color),
+      object_tracking_enabled_(false),
+      ground_truth_tracking_(false), icp_config_(icp_config),
+      mesh_config_(mesh_config), object_gc_timeout_s_(10.0),
+      object_gc_min_observations_(3u), object_gc_min_voxels_(100u) {
   getConfigFromRosParam(nh_private);
 
   last_segment_msg_time_ = ros::Time(0);
@@ -64,6 +75,17 @@ Controller::Controller(const ros::NodeHandle &nh,
       nh_.subscribe(segment_pointcloud_topic, pointcloud_queue_size,
                     &Controller::segmentPointcloudCallback, this);
 
+  // Optionally subscribe to compact segmented frames, i.e. depth, color and
+  // instance label images from which the segments are unprojected.
+  std::string segmented_frame_topic = "";
+  nh_private_.param<std::string>("segmented_frame_topic",
+                                 segmented_frame_topic, segmented_frame_topic);
+  if (!segmented_frame_topic.empty()) {
+    segmented_frame_sub_ =
+        nh_.subscribe(segmented_frame_topic, pointcloud_queue_size,
+                      &Controller::segmentedFrameCallback, this);
+  }
+
   std::string reset_topic = "/tsdf_plusplus_node/reset";
   nh_private_.param<std::string>("reset_topic", reset_topic, reset_topic);
   reset_sub_ = nh_.subscribe(reset_topic, 1, &Controller::resetCallback, this);
@@ -72,11 +94,10 @@ Controller::Controller(const ros::NodeHandle &nh,
   map_.reset(new Map(map_config));
   integrator_.reset(new Integrator(integrator_config, map_));
 
-  icp_.reset(new ICP(icp_config));
+  // ICP and the mesh integrator are optional, they are created on first use.
 
   // Initialize mesh and mesh integrator.
   mesh_layer_.reset(new MeshLayer(map_->block_size()));
-  mesh_integrator_.reset(new MOMeshIntegrator(mesh_config, map_, mesh_layer_));
   mesh_layer_updated_.reset(new bool(false));
   mesh_layer_mutex_.reset(new std::mutex);
 
@@ -107,6 +128,45 @@ Controller::Controller(const ros::NodeHandle &nh,
     write_frames_to_file_ = false;
   }
 
+  bool enable_frame_export = false;
+  nh_private_.param("frame_export/enable", enable_frame_export,
+                    enable_frame_export);
+
+  if (enable_frame_export) {
+    FrameExporter::Config exporter_config;
+    exporter_config.export_path = export_path_;
+    int writer_threads = exporter_config.writer_threads;
+    int max_queued_frames = exporter_config.max_queued_frames;
+    nh_private_.param("frame_export/export_path", exporter_config.export_path,
+                      exporter_config.export_path);
+    nh_private_.param("frame_export/writer_threads", writer_threads,
+                      writer_threads);
+    nh_private_.param("frame_export/max_queued_frames", max_queued_frames,
+                      max_queued_frames);
+    exporter_config.writer_threads = writer_threads;
+    exporter_config.max_queued_frames = max_queued_frames;
+
+    // Render with the camera intrinsics, by default
+    // assuming a principal point in the image center.
+    ObjectRaycaster::Config raycaster_config;
+    raycaster_config.fx = camera_intrinsics_(0, 0);
+    raycaster_config.fy = camera_intrinsics_(1, 1);
+    raycaster_config.cx = camera_intrinsics_(0, 2);
+    raycaster_config.cy = camera_intrinsics_(1, 2);
+    int image_width = std::lround(2.0f * raycaster_config.cx);
+    int image_height = std::lround(2.0f * raycaster_config.cy);
+    nh_private_.param("frame_export/image_width", image_width, image_width);
+    nh_private_.param("frame_export/image_height", image_height,
+                      image_height);
+    raycaster_config.image_width = image_width;
+    raycaster_config.image_height = image_height;
+    nh_private_.param("frame_export/max_depth", raycaster_config.max_depth,
+                      raycaster_config.max_depth);
+
+    frame_exporter_.reset(
+        new FrameExporter(exporter_config, raycaster_config, map_));
+  }
+
   // Advertise services.
   generate_mesh_srv_ = nh_private_.advertiseService(
       "generate_mesh", &Controller::generateMeshCallback, this);
@@ -117,13 +177,93 @@ Controller::Controller(const ros::NodeHandle &nh,
 
   // Advertise publishers.
   mesh_pub_ = nh_private_.advertise<voxblox_msgs::Mesh>("mesh", 1, true);
+  if (publish_mesh_) {
+    mesh_snapshot_buffer_.reset(new MeshSnapshotBuffer);
+    mesh_publisher_.reset(new MeshPublisher(
+        mesh_pub_, world_frame_, map_->block_size(), mesh_snapshot_buffer_));
+  }
   reward_pub_ =
       nh_private_.advertise<tsdf_plusplus_msgs::Reward>("reward", 1, true);
   map_pub_ = nh_private_.advertise<tsdf_plusplus_msgs::SegmentedPointCloud>(
       "map", 1, true);
+
+  bool enable_shm_observations = false;
+  nh_private_.param("shm_observations/enable", enable_shm_observations,
+                    enable_shm_observations);
+
+  if (enable_shm_observations) {
+    // By default the segment is named after the node, such that several
+    // nodes on one host write to separate segments.
+    std::string shm_name = "/tsdf_plusplus_observations" +
+                           ros::this_node::getName();
+    std::replace(shm_name.begin() + 1, shm_name.end(), '/', '_');
+    int shm_num_slots = 8;
+    int shm_max_objects = 256;
+    nh_private_.param("shm_observations/name", shm_name, shm_name);
+    nh_private_.param("shm_observations/num_slots", shm_num_slots,
+                      shm_num_slots);
+    nh_private_.param("shm_observations/max_objects", shm_max_objects,
+                      shm_max_objects);
+
+    if (shm_num_slots < 1 ||
+        shm_num_slots > static_cast<int>(ShmObservationWriter::kMaxNumSlots)) {
+      ROS_ERROR("shm_observations/num_slots must be between 1 and %zu, "
+                "setting to default value.",
+                ShmObservationWriter::kMaxNumSlots);
+      shm_num_slots = 8;
+    }
+    if (shm_max_objects < 0 ||
+        shm_max_objects > static_cast<int>(ShmObservationWriter::kMaxObjects)) {
+      ROS_ERROR("shm_observations/max_objects must be between 0 and %zu, "
+                "setting to default value.",
+                ShmObservationWriter::kMaxObjects);
+      shm_max_objects = 256;
+    }
+
+    shm_observation_writer_.reset(new ShmObservationWriter(
+        shm_name, static_cast<size_t>(shm_num_slots),
+        static_cast<size_t>(shm_max_objects)));
+    if (!shm_observation_writer_->isOpen()) {
+      shm_observation_writer_.reset();
+    }
+  }
+
+  // If enabled, periodically remove the spurious objects left behind by
+  // noisy segmentation, such that their ids can be reused.
+  bool enable_object_gc = false;
+  nh_private_.param("object_gc/enable", enable_object_gc, enable_object_gc);
+
+  if (enable_object_gc) {
+    double object_gc_interval_s = 5.0;
+    int object_gc_min_observations =
+        static_cast<int>(object_gc_min_observations_);
+    int object_gc_min_voxels = static_cast<int>(object_gc_min_voxels_);
+    nh_private_.param("object_gc/interval_s", object_gc_interval_s,
+                      object_gc_interval_s);
+    nh_private_.param("object_gc/timeout_s", object_gc_timeout_s_,
+                      object_gc_timeout_s_);
+    nh_private_.param("object_gc/min_observations", object_gc_min_observations,
+                      object_gc_min_observations);
+    nh_private_.param("object_gc/min_voxels", object_gc_min_voxels,
+                      object_gc_min_voxels);
+    object_gc_min_observations_ =
+        static_cast<size_t>(std::max(object_gc_min_observations, 0));
+    object_gc_min_voxels_ =
+        static_cast<size_t>(std::max(object_gc_min_voxels, 0));
+
+    if (object_gc_interval_s > 0.0) {
+      object_gc_timer_ =
+          nh_private_.createTimer(ros::Duration(object_gc_interval_s),
+                                  &Controller::collectObjectsEvent, this);
+    }
+  }
 }
 
-Controller::~Controller() { vizualizer_thread_.join(); }
+Controller::~Controller() {
+  if (vizualizer_thread_.joinable()) {
+    vizualizer_thread_.join();
+  }
+}
 
 void Controller::getConfigFromRosParam(const ros::NodeHandle &nh_private) {
   nh_private.param("world_frame", world_frame_, world_frame_);
@@ -140,10 +280,6 @@ void Controller::getConfigFromRosParam(const ros::NodeHandle &nh_private) {
   nh_private.param("object_tracking/ground_truth_tracking",
                    ground_truth_tracking_, ground_truth_tracking_);
 
-  // Human-readable semantic classes.
-  nh_private.param<std::vector<std::string>>(
-      "semantic_classes", semantic_classes_, semantic_classes_);
-
   // Mesh settings.
   nh_private.param("meshing/publish_mesh", publish_mesh_, publish_mesh_);
   nh_private.param("meshing/mesh_filename", mesh_filename_, mesh_filename_);
@@ -167,17 +303,41 @@ void Controller::getConfigFromRosParam(const ros::NodeHandle &nh_private) {
 }
 
 void Controller::segmentPointcloudCallback(
-    const tsdf_plusplus_msgs::SegmentedPointCloud::Ptr &segment_pcl_msg) {
+    const tsdf_plusplus_msgs::SegmentedPointCloud::ConstPtr &segment_pcl_msg) {
+  std::lock_guard<std::mutex> frame_lock(frame_mutex_);
 
   last_segment_msg_time_ = segment_pcl_msg->header.stamp;
   processSegmentPointcloud(segment_pcl_msg);
 
+  finishFrame();
+}
+
+void Controller::segmentedFrameCallback(
+    const tsdf_plusplus_msgs::SegmentedFrame::ConstPtr &segmented_frame_msg) {
+  std::lock_guard<std::mutex> frame_lock(frame_mutex_);
+
+  last_segment_msg_time_ = segmented_frame_msg->header.stamp;
+  processSegmentedFrame(segmented_frame_msg);
+
+  finishFrame();
+}
+
+void Controller::finishFrame() {
   if (current_frame_segments_.size() > 0u) {
     LOG(INFO) << "Integrating frame " << ++frame_number_ << " with timestamp "
               << std::fixed << last_segment_msg_time_.toSec();
     integrateFrame();
 
-    if (write_frames_to_file_) {
+    if (!first_integration_reported_) {
+      reportFirstIntegration();
+    }
+
+    if (frame_exporter_) {
+      // Project the object map to 2D segmentation images in the background,
+      // from a snapshot of the map taken under the reader lock.
+      std::shared_lock<std::shared_timed_mutex> map_lock(map_mutex_);
+      frame_exporter_->exportFrame(frame_number_, T_G_C_);
+    } else if (write_frames_to_file_) {
       // Project the object map to 2D segmentation images.
       visualizer_->triggerScreenshot(frame_number_);
     }
@@ -194,6 +354,9 @@ void Controller::resetCallback(const std_msgs::Bool::Ptr &reset_msg) {
   if (!reset_msg->data)
     return;
 
+  // Waits for the frame being processed, if any, to be integrated.
+  std::lock_guard<std::mutex> frame_lock(frame_mutex_);
+
   // Reset Varibales to Reset Map State
   frame_number_ = 0u;
   *mesh_layer_updated_ = false; // ????
@@ -201,40 +364,59 @@ void Controller::resetCallback(const std_msgs::Bool::Ptr &reset_msg) {
 
   last_segment_msg_time_ = ros::Time(0);
 
-  map_->clear();
-  mesh_layer_->clear();
-
+  {
+    std::unique_lock<std::shared_timed_mutex> map_lock(map_mutex_);
+    map_->clear();
+  }
   clearFrame();
+  segment_pool_.clear();
+  {
+    std::lock_guard<std::mutex> mesh_layer_lock(*mesh_layer_mutex_);
+    mesh_layer_->clear();
+  }
+  if (mesh_snapshot_buffer_) {
+    mesh_snapshot_buffer_->publishClear();
+    mesh_publisher_->notify();
+  }
 }
 
 void Controller::processSegmentPointcloud(
-    const tsdf_plusplus_msgs::SegmentedPointCloud::Ptr &segment_pcl_msg) {
+    const tsdf_plusplus_msgs::SegmentedPointCloud::ConstPtr &segment_pcl_msg) {
   // Look up transform from camera frame to world frame.
   if (lookupTransformTF(segment_pcl_msg->header.frame_id, world_frame_,
                         segment_pcl_msg->header.stamp, &T_G_C_)) {
     // Convert the PCL pointcloud into a Segment instance.
     voxblox::timing::Timer preprocess_timer("preprocess/segment");
 
-    for (auto &segment_msg : segment_pcl_msg->segments) {
-      // Horrible hack fix to fix color parsing colors in PCL.
-      for (size_t d = 0u; d < segment_msg.pointcloud.fields.size(); ++d) {
-        if (segment_msg.pointcloud.fields[d].name == std::string("rgb")) {
-          segment_msg.pointcloud.fields[d].datatype =
-              sensor_msgs::PointField::FLOAT32;
-        }
-      }
-
+    for (const auto &segment_msg : segment_pcl_msg->segments) {
+      // The message may be shared with other nodelets, so it is converted
+      // without modifying it.
       Segment *segment;
       if (using_ground_truth_segmentation_) {
-        pcl::PointCloud<GTInputPointType> pointcloud_pcl;
-        pcl::moveFromROSMsg(segment_msg.pointcloud, pointcloud_pcl);
+        if (!convertPointcloudMsg(segment_msg.pointcloud,
+                                  &gt_segment_cloud_)) {
+          ROS_ERROR("Malformed segment pointcloud, skipping segment.");
+          continue;
+        }
+        if (gt_segment_cloud_.empty()) {
+          continue;
+        }
 
-        segment = new Segment(pointcloud_pcl, T_G_C_, segment_msg.object_id);
+        segment = segment_pool_.acquire(gt_segment_cloud_, T_G_C_,
+                                        segment_msg.object_id,
+                                        integrate_color_);
       } else {
-        pcl::PointCloud<InputPointType> pointcloud_pcl;
-        pcl::moveFromROSMsg(segment_msg.pointcloud, pointcloud_pcl);
+        if (!convertPointcloudMsg(segment_msg.pointcloud, &segment_cloud_)) {
+          ROS_ERROR("Malformed segment pointcloud, skipping segment.");
+          continue;
+        }
+        // The semantic class is read from the first point.
+        if (segment_cloud_.empty()) {
+          continue;
+        }
 
-        segment = new Segment(pointcloud_pcl, T_G_C_);
+        segment =
+            segment_pool_.acquire(segment_cloud_, T_G_C_, integrate_color_);
       }
 
       // Add the segment to the collection of
@@ -243,19 +425,169 @@ void Controller::processSegmentPointcloud(
 
       if (ground_truth_tracking_) {
         // Convert Movement to Eigen Matrix
-        Eigen::Matrix4f movement =
-            Eigen::Map<Eigen::Matrix4f>(segment_msg.movement.data.data());
+        Eigen::Matrix4f movement = Eigen::Map<const Eigen::Matrix4f>(
+            segment_msg.movement.data.data());
         current_frame_movements_.push_back({segment_msg.is_moved, movement});
       }
-
-      if (!using_ground_truth_segmentation_) {
-        integrator_->computeObjectOverlap(segment, &object_segment_overlap_);
-      }
     }
     preprocess_timer.Stop();
   }
 }
 
+void Controller::processSegmentedFrame(
+    const tsdf_plusplus_msgs::SegmentedFrame::ConstPtr &segmented_frame_msg) {
+  // Look up transform from camera frame to world frame.
+  if (!lookupTransformTF(segmented_frame_msg->header.frame_id, world_frame_,
+                         segmented_frame_msg->header.stamp, &T_G_C_)) {
+    return;
+  }
+
+  voxblox::timing::Timer preprocess_timer("preprocess/segment");
+
+  const sensor_msgs::Image &depth_msg = segmented_frame_msg->depth;
+  const sensor_msgs::Image &rgb_msg = segmented_frame_msg->rgb;
+  const sensor_msgs::Image &label_msg = segmented_frame_msg->instance_labels;
+
+  const bool depth_in_mm =
+      depth_msg.encoding == sensor_msgs::image_encodings::TYPE_16UC1;
+  if (!depth_in_mm &&
+      depth_msg.encoding != sensor_msgs::image_encodings::TYPE_32FC1) {
+    ROS_ERROR_STREAM("Unsupported depth encoding " << depth_msg.encoding
+                                                   << ".");
+    return;
+  }
+
+  if (label_msg.encoding != sensor_msgs::image_encodings::TYPE_16UC1) {
+    ROS_ERROR_STREAM("Unsupported instance label encoding "
+                     << label_msg.encoding << ".");
+    return;
+  }
+
+  // The color image is ignored altogether if colors are not integrated.
+  const bool rgb_order =
+      rgb_msg.encoding == sensor_msgs::image_encodings::RGB8 ||
+      rgb_msg.encoding == sensor_msgs::image_encodings::RGBA8;
+  const bool bgr_order =
+      rgb_msg.encoding == sensor_msgs::image_encodings::BGR8 ||
+      rgb_msg.encoding == sensor_msgs::image_encodings::BGRA8;
+  if (integrate_color_ && !rgb_order && !bgr_order) {
+    ROS_ERROR_STREAM("Unsupported color encoding " << rgb_msg.encoding
+                                                   << ".");
+    return;
+  }
+
+  if (depth_msg.width != label_msg.width ||
+      depth_msg.height != label_msg.height ||
+      (integrate_color_ && (depth_msg.width != rgb_msg.width ||
+                            depth_msg.height != rgb_msg.height))) {
+    ROS_ERROR("Depth, color and instance label images differ in size.");
+    return;
+  }
+
+  if (!isImageLayoutValid(depth_msg) || !isImageLayoutValid(label_msg) ||
+      (integrate_color_ && !isImageLayoutValid(rgb_msg))) {
+    ROS_ERROR("Image steps or data sizes do not match the image sizes.");
+    return;
+  }
+
+  // Segments indexed by their instance label.
+  std::unordered_map<uint16_t, Segment *> label_segments;
+  for (const auto &instance_msg : segmented_frame_msg->instances) {
+    if (label_segments.count(instance_msg.label) == 0u) {
+      label_segments.emplace(
+          instance_msg.label,
+          segment_pool_.acquire(T_G_C_, instance_msg.object_id,
+                                instance_msg.semantic_class));
+    }
+  }
+
+  SegmentImages images;
+  images.width = depth_msg.width;
+  images.height = depth_msg.height;
+  images.depth = depth_msg.data.data();
+  images.depth_step = depth_msg.step;
+  images.depth_in_mm = depth_in_mm;
+  if (integrate_color_) {
+    images.color = rgb_msg.data.data();
+    images.color_step = rgb_msg.step;
+    images.color_channels =
+        sensor_msgs::image_encodings::numChannels(rgb_msg.encoding);
+    images.bgr_order = bgr_order;
+  }
+  images.labels = label_msg.data.data();
+  images.labels_step = label_msg.step;
+  images.fx = segmented_frame_msg->K[0];
+  images.fy = segmented_frame_msg->K[4];
+  images.cx = segmented_frame_msg->K[2];
+  images.cy = segmented_frame_msg->K[5];
+
+  unprojectSegments(images, label_segments);
+
+  // Add the non-empty segments to the collection
+  // of segments observed in the current frame.
+  for (const auto &instance_msg : segmented_frame_msg->instances) {
+    auto segment_it = label_segments.find(instance_msg.label);
+    if (segment_it == label_segments.end() || segment_it->second == nullptr) {
+      continue;
+    }
+
+    Segment *segment = segment_it->second;
+    // Each label is only added once, even if listed again.
+    segment_it->second = nullptr;
+
+    // Empty segments go back to the pool with the rest of the frame.
+    if (segment->points_C_.empty()) {
+      continue;
+    }
+
+    current_frame_segments_.push_back(segment);
+
+    if (ground_truth_tracking_) {
+      Eigen::Matrix4f movement = Eigen::Map<const Eigen::Matrix4f>(
+          instance_msg.movement.data.data());
+      current_frame_movements_.push_back({instance_msg.is_moved, movement});
+    }
+  }
+
+  preprocess_timer.Stop();
+}
+
+ICP *Controller::getICP() {
+  if (!icp_) {
+    icp_.reset(new ICP(icp_config_));
+  }
+  return icp_.get();
+}
+
+MOMeshIntegrator *Controller::getMeshIntegrator() {
+  if (!mesh_integrator_) {
+    mesh_integrator_.reset(
+        new MOMeshIntegrator(mesh_config_, map_, mesh_layer_));
+  }
+  return mesh_integrator_.get();
+}
+
+void Controller::reportFirstIntegration() {
+  // Time budget from startup to the first integrated frame.
+  constexpr double kStartupTargetMs = 100.0;
+
+  const double startup_ms =
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - startup_time_)
+          .count();
+
+  if (startup_ms > kStartupTargetMs) {
+    LOG(WARNING) << "First frame integrated " << startup_ms
+                 << " ms after startup, above the target of "
+                 << kStartupTargetMs << " ms.";
+  } else {
+    LOG(INFO) << "First frame integrated " << startup_ms
+              << " ms after startup.";
+  }
+
+  first_integration_reported_ = true;
+}
+
 bool Controller::lookupTransformTF(const std::string &from_frame,
                                    const std::string &to_frame,
                                    const ros::Time &timestamp,
@@ -292,25 +624,30 @@ bool Controller::lookupTransformTF(const std::string &from_frame,
 void Controller::integrateFrame() {
   pcl::console::TicToc tic_toc;
 
-  if (!using_ground_truth_segmentation_) {
-    voxblox::timing::Timer object_assignment_timer(
-        "preprocess/assign_object_ids");
-
-    tic_toc.tic();
-    // All segments in the current frame have been processed and their
-    // parwise overlap with objects in the map have been computed, now make an
-    // ERRORrmed decision about which segment gets assigned which object_id.
-    integrator_->assignObjectIds(&current_frame_segments_,
-                                 &object_segment_overlap_,
-                                 &object_merged_segments_);
-
-    integrateSemanticClasses();
+  {
+    // Segments are matched to objects and assigned ids under the same lock as
+    // their integration. Otherwise an object could be removed in between,
+    // e.g. by the object garbage collection, and its recycled id handed out
+    // while a segment still gets integrated into it.
+    std::unique_lock<std::shared_timed_mutex> map_lock(map_mutex_);
+
+    if (!using_ground_truth_segmentation_) {
+      voxblox::timing::Timer object_assignment_timer(
+          "preprocess/assign_object_ids");
+
+      // Compute the pairwise overlap of the segments in the current frame
+      // with the objects in the map, then make an informed decision about
+      // which segment gets assigned which object_id.
+      for (Segment *segment : current_frame_segments_) {
+        integrator_->computeObjectOverlap(segment, &segment_overlaps_);
+      }
+      integrator_->assignObjectIds(&current_frame_segments_,
+                                   &segment_overlaps_, &merged_segments_);
 
-    object_assignment_timer.Stop();
-  }
+      integrateSemanticClasses();
 
-  {
-    std::lock_guard<std::mutex> map_lock(map_mutex_);
+      object_assignment_timer.Stop();
+    }
 
     if (object_tracking_enabled_) {
       timing::Timer tracking_timer("all/track_and_update_poses");
@@ -324,16 +661,9 @@ void Controller::integrateFrame() {
     tic_toc.tic();
 
     if (using_ground_truth_segmentation_) {
-      for (Segment *segment : current_frame_segments_) {
-        integrator_->integrateSegment(*segment);
-      }
-
+      integrator_->integrateSegments(current_frame_segments_);
     } else {
-      for (const auto &pair : object_merged_segments_) {
-        Segment *segment = pair.second;
-        segment->convertPointcloud();
-        integrator_->integrateSegment(*segment);
-      }
+      integrator_->integrateSegments(merged_segments_);
     }
 
     integrate_timer.Stop();
@@ -342,7 +672,7 @@ void Controller::integrateFrame() {
       LOG(INFO) << "Integrated " << current_frame_segments_.size()
                 << " segments in " << tic_toc.toc() << " ms. ";
     } else {
-      LOG(INFO) << "Integrated " << object_merged_segments_.size()
+      LOG(INFO) << "Integrated " << merged_segments_.size()
                 << " segments in " << tic_toc.toc() << " ms. ";
     }
 
@@ -356,8 +686,7 @@ void Controller::integrateFrame() {
 }
 
 void Controller::integrateSemanticClasses() {
-  for (const auto &pair : object_merged_segments_) {
-    Segment *segment = pair.second;
+  for (Segment *segment : merged_segments_) {
     if (segment->semantic_class_ == BackgroundClass) {
       continue;
     }
@@ -431,7 +760,23 @@ void Controller::trackObjects() {
         // Segment extracted from the current frame.
         pcl::PointCloud<PointTypeNormal>::Ptr C_segment_pcl_cloud(
             new pcl::PointCloud<PointTypeNormal>);
-        pcl::copyPointCloud(segment->pointcloud_, *C_segment_pcl_cloud);
+        if (!segment->pointcloud_.empty()) {
+          pcl::copyPointCloud(segment->pointcloud_, *C_segment_pcl_cloud);
+        } else {
+          // Segments unprojected from label images come without normals.
+          C_segment_pcl_cloud->points.resize(segment->points_C_.size());
+          for (size_t j = 0u; j < segment->points_C_.size(); ++j) {
+            C_segment_pcl_cloud->points[j].x = segment->points_C_[j].x();
+            C_segment_pcl_cloud->points[j].y = segment->points_C_[j].y();
+            C_segment_pcl_cloud->points[j].z = segment->points_C_[j].z();
+          }
+          C_segment_pcl_cloud->width = C_segment_pcl_cloud->points.size();
+          C_segment_pcl_cloud->height = 1u;
+
+          constexpr int kNormalNeighbors = 10;
+          estimateNormals<PointTypeNormal>(kNormalNeighbors,
+                                           C_segment_pcl_cloud);
+        }
 
         // Object model stored in the map.
         pcl::PointCloud<PointTypeNormal>::Ptr G_model_pcl_cloud(
@@ -460,7 +805,7 @@ void Controller::trackObjects() {
         Eigen::Matrix4f G_T_S_O = Eigen::Matrix4f::Identity();
 
         // Align the source: segment point cloud to the target: object model.
-        bool success = icp_->align(G_segment_pcl_cloud, G_model_pcl_cloud,
+        bool success = getICP()->align(G_segment_pcl_cloud, G_model_pcl_cloud,
                                    Eigen::Matrix4f::Identity(), &G_T_S_O);
 
         if (!success) {
@@ -487,46 +832,44 @@ void Controller::trackObjects() {
 }
 
 void Controller::clearFrame() {
-  for (Segment *segment : current_frame_segments_) {
-    delete segment;
-  }
+  segment_pool_.releaseAll();
 
   current_frame_segments_.clear();
   current_frame_movements_.clear();
-  object_segment_overlap_.clear();
-  object_merged_segments_.clear();
+  segment_overlaps_.clear();
+  merged_segments_.clear();
 }
 
 void Controller::updateMeshEvent(const ros::TimerEvent &event) {
   std::lock_guard<std::mutex> mesh_layer_lock(*mesh_layer_mutex_);
-  std::lock_guard<std::mutex> map_lock(map_mutex_);
-
-  timing::Timer update_mesh_timer("mesh/update");
 
-  constexpr bool only_mesh_updated_blocks = true;
-  constexpr bool clear_updated_flag = true;
-
-  pcl::console::TicToc tic_toc;
+  BlockIndexList meshed_blocks;
+  {
+    std::shared_lock<std::shared_timed_mutex> map_lock(map_mutex_);
 
-  tic_toc.tic();
+    timing::Timer update_mesh_timer("mesh/update");
 
-  *mesh_layer_updated_ = mesh_integrator_->generateMesh(
-                             only_mesh_updated_blocks, clear_updated_flag) ||
-                         *mesh_layer_updated_;
+    constexpr bool only_mesh_updated_blocks = true;
+    constexpr bool clear_updated_flag = true;
 
-  update_mesh_timer.Stop();
+    *mesh_layer_updated_ =
+        getMeshIntegrator()->generateMesh(only_mesh_updated_blocks,
+                                          clear_updated_flag, &meshed_blocks) ||
+        *mesh_layer_updated_;
 
-  if (publish_mesh_) {
-    timing::Timer mesh_msg_timer("mesh/publish_msg");
+    update_mesh_timer.Stop();
+  }
 
-    voxblox_msgs::Mesh mesh_msg;
-    generateVoxbloxMeshMsg(mesh_layer_.get(), voxblox::ColorMode::kColor,
-                           &mesh_msg);
-    mesh_msg.header.frame_id = world_frame_;
-    mesh_pub_.publish(mesh_msg);
+  publishMeshSnapshots(meshed_blocks);
+}
 
-    mesh_msg_timer.Stop();
+void Controller::publishMeshSnapshots(const BlockIndexList &meshed_blocks) {
+  if (!mesh_snapshot_buffer_ || meshed_blocks.empty()) {
+    return;
   }
+
+  mesh_snapshot_buffer_->publishBlocks(*mesh_layer_, meshed_blocks);
+  mesh_publisher_->notify();
 }
 
 bool Controller::generateMeshCallback(std_srvs::Empty::Request & /*request*/,
@@ -534,32 +877,24 @@ bool Controller::generateMeshCallback(std_srvs::Empty::Request & /*request*/,
                                       /*response*/) {
   {
     std::lock_guard<std::mutex> mesh_layer_lock(*mesh_layer_mutex_);
+
+    BlockIndexList meshed_blocks;
     {
-      std::lock_guard<std::mutex> map_lock(map_mutex_);
+      std::shared_lock<std::shared_timed_mutex> map_lock(map_mutex_);
 
       timing::Timer generate_mesh_timer("mesh/generate");
 
       constexpr bool only_mesh_updated_blocks = false;
       constexpr bool clear_updated_flag = true;
-      mesh_integrator_->generateMesh(only_mesh_updated_blocks,
-                                     clear_updated_flag);
+      getMeshIntegrator()->generateMesh(only_mesh_updated_blocks,
+                                        clear_updated_flag, &meshed_blocks);
 
       *mesh_layer_updated_ = true;
 
       generate_mesh_timer.Stop();
     }
 
-    if (publish_mesh_) {
-      timing::Timer mesh_msg_timer("mesh/publish_msg");
-
-      voxblox_msgs::Mesh mesh_msg;
-      generateVoxbloxMeshMsg(mesh_layer_.get(), voxblox::ColorMode::kColor,
-                             &mesh_msg);
-      mesh_msg.header.frame_id = world_frame_;
-      mesh_pub_.publish(mesh_msg);
-
-      mesh_msg_timer.Stop();
-    }
+    publishMeshSnapshots(meshed_blocks);
 
     if (!mesh_filename_.empty()) {
       const bool success = outputMeshLayerAsPly(mesh_filename_, *mesh_layer_);
@@ -577,8 +912,12 @@ bool Controller::generateMeshCallback(std_srvs::Empty::Request & /*request*/,
 bool Controller::saveObjectsCallback(std_srvs::Empty::Request & /*request*/,
                                      std_srvs::Empty::Response &
                                      /*response*/) {
+  // Copy the object layers under a reader lock and write
+  // them to file without blocking the integration.
+  std::vector<std::pair<ObjectID, std::unique_ptr<Layer<TsdfVoxel>>>>
+      object_layers;
   {
-    std::lock_guard<std::mutex> map_lock(map_mutex_);
+    std::shared_lock<std::shared_timed_mutex> map_lock(map_mutex_);
 
     std::map<ObjectID, ObjectVolume *> *object_volumes =
         map_->getObjectVolumesPtr();
@@ -589,20 +928,27 @@ bool Controller::saveObjectsCallback(std_srvs::Empty::Request & /*request*/,
           pair.first != 2u) {
         continue;
       }
-      CHECK_EQ(makePath("tpp_objects", 0777), 0);
 
-      std::string mesh_filename =
-          "tpp_objects/tpp_object_" + std::to_string(pair.first) + ".ply";
+      object_layers.emplace_back(
+          pair.first, std::unique_ptr<Layer<TsdfVoxel>>(new Layer<TsdfVoxel>(
+                          *pair.second->getTsdfLayerPtr())));
+    }
+  }
 
-      bool success = voxblox::io::outputLayerAsPly(
-          *pair.second->getTsdfLayerPtr(), mesh_filename,
-          voxblox::io::PlyOutputTypes::kSdfIsosurface);
+  for (const auto &pair : object_layers) {
+    CHECK_EQ(makePath("tpp_objects", 0777), 0);
 
-      if (success) {
-        LOG(INFO) << "Output object file as PLY: " << mesh_filename.c_str();
-      } else {
-        LOG(INFO) << "Failed to output mesh as PLY:" << mesh_filename.c_str();
-      }
+    std::string mesh_filename =
+        "tpp_objects/tpp_object_" + std::to_string(pair.first) + ".ply";
+
+    bool success = voxblox::io::outputLayerAsPly(
+        *pair.second, mesh_filename,
+        voxblox::io::PlyOutputTypes::kSdfIsosurface);
+
+    if (success) {
+      LOG(INFO) << "Output object file as PLY: " << mesh_filename.c_str();
+    } else {
+      LOG(INFO) << "Failed to output mesh as PLY:" << mesh_filename.c_str();
     }
   }
 
@@ -612,7 +958,7 @@ bool Controller::saveObjectsCallback(std_srvs::Empty::Request & /*request*/,
 bool Controller::publishReward() {
 
   {
-    std::lock_guard<std::mutex> map_lock(map_mutex_);
+    std::shared_lock<std::shared_timed_mutex> map_lock(map_mutex_);
     Layer<MOVoxel> *global_map = map_->getMapLayerPtr();
     // Get the indices of all allocated voxels
     BlockIndexList global_map_blocks;
@@ -632,8 +978,14 @@ bool Controller::publishReward() {
       msg.number_of_objects++;      
     }
 
+    ObjectID last_object_id;
+    ObjectVolume *last_object_volume = nullptr;
+    Block<TsdfVoxel> *last_tsdf_block = nullptr;
+    BlockIndex last_tsdf_block_idx;
+
     for (const BlockIndex &block_index : global_map_blocks){
-      auto global_map_block =  global_map->getBlockPtrByIndex(block_index);
+      const Block<MOVoxel> *global_map_block =
+          map_->getMapBlockPtrByIndex(block_index);
 
       // Iterate over all voxels inside the block
       for(int i=0; i<global_map_block->num_voxels(); i++){
@@ -641,23 +993,32 @@ bool Controller::publishReward() {
         msg.number_of_voxels++;
 
         // Get Global Map Voxel
-        auto voxel = global_map_block->getVoxelByLinearIndex(i);
-        auto voxel_center = global_map_block->computeCoordinatesFromLinearIndex(i);
+        const MOVoxel &voxel = global_map_block->getVoxelByLinearIndex(i);
 
-        if(voxel.active_object.object_id == 0u){
-            msg.number_of_unknown_voxels++; // Check these voxels
-            continue;
+        if(voxel.active_object().object_id == 0u){
+          // Free space is only tracked in the global map.
+          if(voxel.free_confidence() > 0u){
+            msg.number_of_free_voxels++;
+          }else{
+            msg.number_of_unknown_voxels++;
+          }
+          continue;
         }
 
         // Get Object Volume Voxel
-        auto object_volume = (*object_volumes)[voxel.active_object.object_id];
-        auto object_volume_block = object_volume->getTsdfLayerPtr();
-        auto tsdf_voxel = object_volume_block->getVoxelPtrByCoordinates(voxel_center);
-
-        if(tsdf_voxel->weight < 1e-6){
+        const GlobalIndex global_voxel_idx =
+            map_->getVoxelIndexer().getGlobalVoxelIndex(
+                block_index,
+                global_map_block->computeVoxelIndexFromLinearIndex(i));
+        const TsdfVoxel *tsdf_voxel = map_->getAllocatedTsdfVoxelPtr(
+            voxel.active_object().object_id, global_voxel_idx,
+            &last_object_volume, &last_object_id, &last_tsdf_block,
+            &last_tsdf_block_idx);
+
+        if(tsdf_voxel == nullptr || tsdf_voxel->weight < 1e-6){
           msg.number_of_unknown_voxels++;
         }else{
-          if(abs(tsdf_voxel->distance) < (object_volume_block->voxel_size()/2)){
+          if(abs(tsdf_voxel->distance) < (global_map->voxel_size()/2)){
             msg.number_of_occupied_voxels++;
           }else{
             msg.number_of_free_voxels++;
@@ -668,6 +1029,36 @@ bool Controller::publishReward() {
     }
 
     reward_pub_.publish(msg);
+
+    if (shm_observation_writer_) {
+      ShmRewardCounters reward;
+      reward.number_of_objects = msg.number_of_objects;
+      reward.number_of_voxels = msg.number_of_voxels;
+      reward.number_of_free_voxels = msg.number_of_free_voxels;
+      reward.number_of_occupied_voxels = msg.number_of_occupied_voxels;
+      reward.number_of_unknown_voxels = msg.number_of_unknown_voxels;
+      reward.padding = 0u;
+
+      std::vector<ShmObjectSummary> objects;
+      objects.reserve(object_volumes->size());
+      for (const auto &pair : *object_volumes) {
+        ShmObjectSummary object;
+        object.object_id = pair.first;
+        object.semantic_class = pair.second->getSemanticClass();
+        object.number_of_blocks =
+            pair.second->getTsdfLayerPtr()->getNumberOfAllocatedBlocks();
+
+        const Point position = pair.second->getPose().getPosition();
+        object.position[0] = position.x();
+        object.position[1] = position.y();
+        object.position[2] = position.z();
+        objects.push_back(object);
+      }
+
+      shm_observation_writer_->write(frame_number_,
+                                     last_segment_msg_time_.toSec(), reward,
+                                     objects);
+    }
   }
 
   return true;
@@ -676,7 +1067,7 @@ bool Controller::publishReward() {
 bool Controller::publishMap() {
 
   {
-    std::lock_guard<std::mutex> map_lock(map_mutex_);
+    std::shared_lock<std::shared_timed_mutex> map_lock(map_mutex_);
 
     tsdf_plusplus_msgs::SegmentedPointCloud msg;
     msg.header.frame_id = world_frame_;
@@ -727,21 +1118,116 @@ bool Controller::removeObjectsCallback(std_srvs::Empty::Request & /*request*/,
                                        std_srvs::Empty::Response &
                                        /*response*/) {
   {
-    std::lock_guard<std::mutex> map_lock(map_mutex_);
+    // The export below is of the current frame.
+    std::lock_guard<std::mutex> frame_lock(frame_mutex_);
+
+    // Same locking order as the mesh update, the meshes of the pruned map
+    // blocks are removed along with the objects.
+    std::lock_guard<std::mutex> mesh_layer_lock(*mesh_layer_mutex_);
+    std::unique_lock<std::shared_timed_mutex> map_lock(map_mutex_);
 
     std::map<ObjectID, ObjectVolume *> *object_volumes =
         map_->getObjectVolumesPtr();
 
-    // Remove all Objects
+    // Removing an object erases it from object_volumes.
+    std::vector<ObjectID> object_ids;
+    object_ids.reserve(object_volumes->size());
     for (const auto &pair : *object_volumes) {
-      map_->removeObject(pair.first);
+      object_ids.push_back(pair.first);
+    }
+
+    // Remove all Objects
+    BlockIndexList pruned_block_indices;
+    size_t freed_bytes = 0u;
+    for (const ObjectID &object_id : object_ids) {
+      freed_bytes += removeObject(object_id, &pruned_block_indices);
     }
+    removeMeshBlocks(pruned_block_indices);
     *mesh_layer_updated_ = true;
 
-    if (write_frames_to_file_) {
+    LOG(INFO) << "Removed " << object_ids.size() << " objects and "
+              << pruned_block_indices.size() << " map blocks, freed "
+              << freed_bytes / 1024u << " KiB.";
+
+    if (frame_exporter_) {
+      // Project the object map to 2D segmentation images in the background.
+      frame_exporter_->exportFrame(frame_number_, T_G_C_);
+    } else if (write_frames_to_file_) {
       // Project the object map to 2D segmentation images.
       visualizer_->triggerScreenshot(frame_number_);
     }
   }
   return true;
 }
+
+size_t Controller::removeObject(const ObjectID &object_id,
+                                BlockIndexList *pruned_block_indices) {
+  const size_t freed_bytes =
+      map_->removeObject(object_id, pruned_block_indices);
+
+  if (mesh_integrator_) {
+    mesh_integrator_->removeObject(object_id);
+  }
+
+  return freed_bytes;
+}
+
+void Controller::removeMeshBlocks(const BlockIndexList &pruned_block_indices) {
+  if (pruned_block_indices.empty()) {
+    return;
+  }
+
+  for (const BlockIndex &block_index : pruned_block_indices) {
+    mesh_layer_->removeMesh(block_index);
+  }
+
+  if (mesh_snapshot_buffer_) {
+    mesh_snapshot_buffer_->publishRemovedBlocks(pruned_block_indices);
+    mesh_publisher_->notify();
+  }
+}
+
+void Controller::collectObjectsEvent(const ros::TimerEvent & /*event*/) {
+  std::lock_guard<std::mutex> mesh_layer_lock(*mesh_layer_mutex_);
+  std::unique_lock<std::shared_timed_mutex> map_lock(map_mutex_);
+
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  const std::chrono::duration<double> timeout(object_gc_timeout_s_);
+
+  // Objects that have not been observed for a while, and were either observed
+  // in too few frames or consist of too few voxels, are deemed spurious.
+  // The semantic class is not considered, as all objects are of the
+  // background class with ground truth or unlabeled segmentation.
+  std::vector<ObjectID> spurious_object_ids;
+  for (const auto &pair : *map_->getObjectVolumesPtr()) {
+    ObjectVolume *object_volume = pair.second;
+
+    if (pair.first == BackgroundID ||
+        now - object_volume->getLastObservationTime() < timeout) {
+      continue;
+    }
+
+    if (object_volume->getNumObservations() < object_gc_min_observations_ ||
+        object_volume->countObservedVoxels(mesh_config_.min_weight) <
+            object_gc_min_voxels_) {
+      spurious_object_ids.push_back(pair.first);
+    }
+  }
+
+  if (spurious_object_ids.empty()) {
+    return;
+  }
+
+  BlockIndexList pruned_block_indices;
+  size_t freed_bytes = 0u;
+  for (const ObjectID &object_id : spurious_object_ids) {
+    freed_bytes += removeObject(object_id, &pruned_block_indices);
+  }
+  removeMeshBlocks(pruned_block_indices);
+  *mesh_layer_updated_ = true;
+
+  LOG(INFO) << "Removed " << spurious_object_ids.size()
+            << " spurious objects, " << map_->getObjectVolumesPtr()->size()
+            << " objects left, freed " << freed_bytes / 1024u << " KiB.";
+}
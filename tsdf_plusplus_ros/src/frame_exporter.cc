@@ -0,0 +1,167 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include "tsdf_plusplus_ros/frame_exporter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <glog/logging.h>
+#include <pcl/io/png_io.h>
+#include <tsdf_plusplus/utils/file_utils.h>
+#include <voxblox/utils/timing.h>
+
+FrameExporter::FrameExporter(const Config &config,
+                             const ObjectRaycaster::Config &raycaster_config,
+                             std::shared_ptr<Map> map)
+    : config_(config), raycaster_(raycaster_config, map), shutdown_(false),
+      render_done_(false) {
+  if (config_.writer_threads == 0u) {
+    config_.writer_threads = 1u;
+  }
+
+  CHECK_EQ(makePath(config_.export_path, 0777), 0);
+
+  render_thread_ = std::thread(&FrameExporter::renderLoop, this);
+  for (size_t i = 0u; i < config_.writer_threads; ++i) {
+    writer_threads_.emplace_back(&FrameExporter::writeLoop, this);
+  }
+}
+
+FrameExporter::~FrameExporter() {
+  {
+    std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+    shutdown_ = true;
+  }
+  render_condition_.notify_all();
+  render_thread_.join();
+
+  // Writers only stop once the render thread has handed over its last frame.
+  write_condition_.notify_all();
+  for (std::thread &thread : writer_threads_) {
+    thread.join();
+  }
+}
+
+void FrameExporter::exportFrame(uint32_t frame_number,
+                                const Transformation &T_G_C) {
+  {
+    // Frames are queued one at a time, the queue
+    // can only shrink while the snapshot is taken.
+    std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+    if (render_queue_.size() >= config_.max_queued_frames) {
+      LOG(WARNING) << "Export queue full, dropping frame " << frame_number
+                   << ".";
+      return;
+    }
+  }
+
+  RenderJob render_job;
+  render_job.frame_number = frame_number;
+  render_job.snapshot.reset(new ObjectRaycaster::Snapshot);
+
+  voxblox::timing::Timer snapshot_timer("export/snapshot");
+  raycaster_.takeSnapshot(T_G_C, render_job.snapshot.get());
+  snapshot_timer.Stop();
+
+  {
+    std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+    render_queue_.push_back(std::move(render_job));
+  }
+  render_condition_.notify_one();
+}
+
+void FrameExporter::renderLoop() {
+  std::vector<ObjectID> object_ids;
+  std::vector<float> depths;
+
+  while (true) {
+    RenderJob render_job;
+    {
+      std::unique_lock<std::mutex> queue_lock(queue_mutex_);
+      render_condition_.wait(queue_lock, [this] {
+        return shutdown_ || !render_queue_.empty();
+      });
+
+      if (render_queue_.empty()) {
+        render_done_ = true;
+        break;
+      }
+      render_job = std::move(render_queue_.front());
+      render_queue_.pop_front();
+    }
+
+    voxblox::timing::Timer render_timer("export/render");
+    raycaster_.render(*render_job.snapshot, &object_ids, &depths);
+    render_timer.Stop();
+    render_job.snapshot.reset();
+
+    std::unique_ptr<WriteJob> write_job(new WriteJob);
+    write_job->frame_number = render_job.frame_number;
+    write_job->object_ids.swap(object_ids);
+    write_job->depths.resize(depths.size());
+    std::transform(depths.begin(), depths.end(), write_job->depths.begin(),
+                   [](float depth) {
+                     return static_cast<uint16_t>(std::min(
+                         std::round(1000.0f * depth), 65535.0f));
+                   });
+
+    {
+      std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+      write_queue_.push_back(std::move(write_job));
+    }
+    write_condition_.notify_one();
+  }
+
+  // Let the writers finish once the last frame has been handed over.
+  write_condition_.notify_all();
+}
+
+void FrameExporter::writeLoop() {
+  std::vector<std::unique_ptr<WriteJob>> batch;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> queue_lock(queue_mutex_);
+      write_condition_.wait(queue_lock, [this] {
+        return render_done_ || !write_queue_.empty();
+      });
+
+      if (write_queue_.empty()) {
+        return;
+      }
+
+      // Take a share of the pending frames, leaving the rest to other writers.
+      const size_t batch_size = std::max<size_t>(
+          1u, write_queue_.size() / config_.writer_threads);
+      for (size_t i = 0u; i < batch_size; ++i) {
+        batch.push_back(std::move(write_queue_.front()));
+        write_queue_.pop_front();
+      }
+    }
+
+    for (const std::unique_ptr<WriteJob> &write_job : batch) {
+      writeFrame(*write_job);
+    }
+    batch.clear();
+  }
+}
+
+void FrameExporter::writeFrame(const WriteJob &write_job) {
+  voxblox::timing::Timer write_timer("export/write");
+
+  const ObjectRaycaster::Config &raycaster_config = raycaster_.getConfig();
+  const std::string frame_name = std::to_string(write_job.frame_number);
+
+  pcl::io::saveShortPNGFile(
+      config_.export_path + "/" + frame_name + "_segmentation.png",
+      write_job.object_ids.data(), raycaster_config.image_width,
+      raycaster_config.image_height, 1);
+  pcl::io::saveShortPNGFile(
+      config_.export_path + "/" + frame_name + "_depth.png",
+      write_job.depths.data(), raycaster_config.image_width,
+      raycaster_config.image_height, 1);
+
+  write_timer.Stop();
+}
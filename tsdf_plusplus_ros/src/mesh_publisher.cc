@@ -0,0 +1,85 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include "tsdf_plusplus_ros/mesh_publisher.h"
+
+#include <glog/logging.h>
+#include <voxblox/utils/timing.h>
+#include <voxblox_msgs/Mesh.h>
+#include <voxblox_ros/mesh_vis.h>
+
+MeshPublisher::MeshPublisher(const ros::Publisher &mesh_pub,
+                             const std::string &world_frame,
+                             FloatingPoint block_size,
+                             std::shared_ptr<MeshSnapshotBuffer> snapshot_buffer)
+    : mesh_pub_(mesh_pub), world_frame_(world_frame),
+      snapshot_buffer_(snapshot_buffer), mesh_layer_(block_size),
+      pending_(false), shutdown_(false) {
+  CHECK(snapshot_buffer_);
+
+  publish_thread_ = std::thread(&MeshPublisher::publishLoop, this);
+}
+
+MeshPublisher::~MeshPublisher() {
+  {
+    std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+    shutdown_ = true;
+  }
+  pending_condition_.notify_one();
+  publish_thread_.join();
+}
+
+void MeshPublisher::notify() {
+  {
+    std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+    pending_ = true;
+  }
+  pending_condition_.notify_one();
+}
+
+void MeshPublisher::publishLoop() {
+  MeshSnapshotBuffer::MeshSnapshotMap snapshots;
+
+  while (true) {
+    bool shutdown;
+    {
+      std::unique_lock<std::mutex> pending_lock(pending_mutex_);
+      pending_condition_.wait(pending_lock,
+                              [this] { return pending_ || shutdown_; });
+      pending_ = false;
+      shutdown = shutdown_;
+    }
+
+    bool cleared;
+    if (snapshot_buffer_->takeSnapshots(&snapshots, &cleared)) {
+      timing::Timer mesh_msg_timer("mesh/publish_msg");
+
+      if (cleared) {
+        mesh_layer_.clear();
+      }
+
+      for (const auto &pair : snapshots) {
+        Mesh::Ptr mesh = mesh_layer_.allocateMeshPtrByIndex(pair.first);
+        if (pair.second) {
+          *mesh = *pair.second;
+        } else {
+          // Empty meshes are sent to remove the block, and then deallocated.
+          mesh->clear();
+        }
+        mesh->updated = true;
+      }
+
+      voxblox_msgs::Mesh mesh_msg;
+      generateVoxbloxMeshMsg(&mesh_layer_, voxblox::ColorMode::kColor,
+                             &mesh_msg);
+      mesh_msg.header.frame_id = world_frame_;
+      mesh_pub_.publish(mesh_msg);
+
+      mesh_msg_timer.Stop();
+    }
+
+    if (shutdown) {
+      return;
+    }
+  }
+}
@@ -18,8 +18,12 @@ int main(int argc, char** argv) {
 
   Controller controller(node_handle, node_handle_private);
 
-  // Spinner with a number of threads equal to the number of cores.
-  ros::AsyncSpinner spinner(2);
+  // Callbacks only reading the map share its lock,
+  // so additional threads serve them concurrently.
+  int num_spinner_threads = 2;
+  node_handle_private.param("num_spinner_threads", num_spinner_threads,
+                            num_spinner_threads);
+  ros::AsyncSpinner spinner(num_spinner_threads);
   spinner.start();
   ros::waitForShutdown();
 
@@ -0,0 +1,28 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include <memory>
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "tsdf_plusplus_ros/controller.h"
+
+// Runs the TSDF++ controller inside a nodelet manager, such that segmented
+// pointclouds published by nodelets in the same manager are received as
+// shared pointers instead of being serialized.
+class TsdfPlusPlusNodelet : public nodelet::Nodelet {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  void onInit() override {
+    // Multi-threaded handles, callbacks are served by the manager's threads.
+    controller_.reset(
+        new Controller(getMTNodeHandle(), getMTPrivateNodeHandle()));
+  }
+
+  std::unique_ptr<Controller> controller_;
+};
+
+PLUGINLIB_EXPORT_CLASS(TsdfPlusPlusNodelet, nodelet::Nodelet)
@@ -0,0 +1,134 @@
+// Copyright (c) 2020- Margarita Grinvald, Autonomous Systems Lab, ETH Zurich
+// Licensed under the MIT License (see LICENSE for details)
+
+#include "tsdf_plusplus_ros/shm_observation_writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+constexpr size_t ShmObservationWriter::kMaxNumSlots;
+constexpr size_t ShmObservationWriter::kMaxObjects;
+
+ShmObservationWriter::ShmObservationWriter(const std::string &name,
+                                           size_t num_slots,
+                                           size_t max_objects)
+    : name_(name), num_slots_(num_slots), max_objects_(max_objects),
+      header_(nullptr) {
+  CHECK_GT(num_slots_, 0u);
+  CHECK_LE(num_slots_, kMaxNumSlots);
+  CHECK_LE(max_objects_, kMaxObjects);
+
+  // Keep the slots 8-byte aligned for their atomic sequence.
+  slot_size_ = sizeof(ShmObservationSlot) +
+               max_objects_ * sizeof(ShmObjectSummary);
+  slot_size_ = (slot_size_ + 7u) & ~static_cast<size_t>(7u);
+  size_ = sizeof(ShmObservationHeader) + num_slots_ * slot_size_;
+
+  // Never attach to a segment of another writer, which would then be
+  // overwritten and eventually unlinked by this one.
+  const int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    if (errno == EEXIST) {
+      LOG(ERROR) << "Shared memory " << name_
+                 << " already exists. Another node may be writing to it, or "
+                    "it was left behind by a crashed one, in which case "
+                    "remove /dev/shm"
+                 << name_ << ".";
+    } else {
+      LOG(ERROR) << "Could not open shared memory " << name_ << ": "
+                 << std::strerror(errno);
+    }
+    return;
+  }
+
+  if (ftruncate(fd, size_) != 0) {
+    LOG(ERROR) << "Could not resize shared memory " << name_ << ": "
+               << std::strerror(errno);
+    close(fd);
+    shm_unlink(name_.c_str());
+    return;
+  }
+
+  void *data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // The mapping stays valid after closing the file descriptor.
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Could not map shared memory " << name_ << ": "
+               << std::strerror(errno);
+    shm_unlink(name_.c_str());
+    return;
+  }
+
+  std::memset(data, 0, size_);
+
+  header_ = new (data) ShmObservationHeader;
+  header_->magic = kShmObservationMagic;
+  header_->version = kShmObservationVersion;
+  header_->num_slots = num_slots_;
+  header_->slot_size = slot_size_;
+  header_->max_objects = max_objects_;
+  header_->write_index.store(0u, std::memory_order_relaxed);
+
+  for (size_t i = 0u; i < num_slots_; ++i) {
+    new (getSlotPtr(i)) ShmObservationSlot;
+    getSlotPtr(i)->sequence.store(0u, std::memory_order_relaxed);
+  }
+
+  std::atomic_thread_fence(std::memory_order_release);
+
+  LOG(INFO) << "Writing map observations to shared memory " << name_ << " ("
+            << num_slots_ << " slots of " << slot_size_ << " bytes).";
+}
+
+ShmObservationWriter::~ShmObservationWriter() {
+  if (header_ != nullptr) {
+    munmap(header_, size_);
+    shm_unlink(name_.c_str());
+  }
+}
+
+ShmObservationSlot *ShmObservationWriter::getSlotPtr(uint64_t index) {
+  uint8_t *slots =
+      reinterpret_cast<uint8_t *>(header_) + sizeof(ShmObservationHeader);
+  return reinterpret_cast<ShmObservationSlot *>(
+      slots + (index % num_slots_) * slot_size_);
+}
+
+void ShmObservationWriter::write(
+    uint64_t frame_number, double stamp, const ShmRewardCounters &reward,
+    const std::vector<ShmObjectSummary> &objects) {
+  if (header_ == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> write_lock(write_mutex_);
+
+  const uint64_t write_index =
+      header_->write_index.load(std::memory_order_relaxed);
+  ShmObservationSlot *slot = getSlotPtr(write_index);
+
+  // Mark the slot as being written.
+  const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence + 1u, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  const size_t num_objects = std::min(objects.size(), max_objects_);
+
+  slot->frame_number = frame_number;
+  slot->stamp = stamp;
+  slot->reward = reward;
+  slot->num_objects = num_objects;
+  std::memcpy(reinterpret_cast<uint8_t *>(slot) + sizeof(ShmObservationSlot),
+              objects.data(), num_objects * sizeof(ShmObjectSummary));
+
+  slot->sequence.store(sequence + 2u, std::memory_order_release);
+  header_->write_index.store(write_index + 1u, std::memory_order_release);
+}